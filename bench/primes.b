@@ -0,0 +1,82 @@
+Prime numbers up to 2000 by trial division for bfi_bench
+Prints one prime per line
+Needs cells of at least 16 bits and runs about 4 billion steps
+
+[-]++>[-]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++[->[-]+>
+[-]++>[-]+[>[-]<<[->>>>>>>>>>>>>+>+<<<<<<<<<<<<<<]>>>>>>>>>>>>>>[-<<<<<<
+<<<<<<<<+>>>>>>>>>>>>>>]<[-<<<<<<<<<<<<<[->>+>>>>>>>>>>>>+<<<<<<<<<<<<<<
+]>>>>>>>>>>>>>>[-<<<<<<<<<<<<<<+>>>>>>>>>>>>>>]<]<<<<<<<<<<<<<<<<[->>>>>
+>>>>>>>>>>>+>>>>+<<<<<<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>>>>>>[-<<<<<<<<<<<<
+<<<<<<<<+>>>>>>>>>>>>>>>>>>>>]<<<<<<<<<<<<<<<[->>>>>>>>>>>>>>+>+<<<<<<<<
+<<<<<<<]>>>>>>>>>>>>>>>[-<<<<<<<<<<<<<<<+>>>>>>>>>>>>>>>]<<<<<<<<<<<<<<[
+-]>>>>>>>>>>>>>[<<+<[>-]>[<<<<<<<<<<<+>>>>>>>>>>>>>[-]+<<<+>->]<<->>>-]<
+<<[-]<<<<<<<<<<[->>>>>>>>>>+>+<<<<<<<<<<<]>>>>>>>>>>>[-<<<<<<<<<<<+>>>>>
+>>>>>>]+<[[-]>-<<<<<<<<<<<<<[-]>>>>>>>>>>>>]>[-<<<<<<<<<<<<<<<<<[->>>>>>
+>>>>>>>>>>>>+>>>>>>+<<<<<<<<<<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>>>>>>>>>>[-<
+<<<<<<<<<<<<<<<<<<<<<<<+>>>>>>>>>>>>>>>>>>>>>>>>]<<<<<<<<<<<<<<<<<<<<<[-
+>>>>>>>>>>>>>>>>+>>>>>+<<<<<<<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>>>>>>>[-<<<<
+<<<<<<<<<<<<<<<<<+>>>>>>>>>>>>>>>>>>>>>]<<<<<<[->-[>+>>]>[+[-<+>]>+>>]<<
+<<<]>[-]<<<<<<<<<<<<[-]>[-]>>>>>>>>>>>>[-<<<<<<<<<<<<+>>>>>>>>>>>>]>[-<<
+<<<<<<<<<<<<+>>>>>>>>>>>>>>]<<<<<<<<<<<<<<[-]>[->>>>>>>>>>+>+<<<<<<<<<<<
+]>>>>>>>>>>>[-<<<<<<<<<<<+>>>>>>>>>>>]+<[[-]>-<]>[-<<<<<<<<<<<<<<<<<[-]>
+>[-]>>>>>>>>>>>>>>>]<<<<<<<<<<<[-]<<<<<+>>>>>>>>>>>>>>]<<<<<<<<<<<[-]<[-
+]<]<<[->>>>>>>>>>>>>>+>+<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>[-<<<<<<<<<<<<<<<
++>>>>>>>>>>>>>>>]<[[-]<<<<<<<<<<<<<<<<[->>>>>>>>>>>>>>>>>+>>>>>>+<<<<<<<
+<<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>>>>>>>>>[-<<<<<<<<<<<<<<<<<<<<<<<+>>>>>>
+>>>>>>>>>>>>>>>>>]<<<<<<[->>>>>>>+>>>>>>+<<<<<<<<<<<<<]>>>>>>>>>>>>>[-<<
+<<<<<<<<<<<+>>>>>>>>>>>>>]<<<<<++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<<<]
+>[-]<<[-]<<<<<[-]>>>>>>>>[-<<<<<<<<+>>>>>>>>]>[-<<<<+>>>>]<<<<<<<<<<[-]>
+>>>>>[-<<<<<<+>>>>>>]<<<<<<[->>>>>>>+>>>>>>+<<<<<<<<<<<<<]>>>>>>>>>>>>>[
+-<<<<<<<<<<<<<+>>>>>>>>>>>>>]<<<<<++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<
+<<]>[-]<<[-]<<<<[-]>>>>>>>[-<<<<<<<+>>>>>>>]>[-<<<<+>>>>]<<<<<<<<<<[-]>>
+>>>>[-<<<<<<+>>>>>>]<<<<<<[->>>>>>>+>>>>>>+<<<<<<<<<<<<<]>>>>>>>>>>>>>[-
+<<<<<<<<<<<<<+>>>>>>>>>>>>>]<<<<<++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<<
+<]>[-]<<[-]<<<[-]>>>>>>[-<<<<<<+>>>>>>]>[-<<<<+>>>>]<<<<<<<<<<[-]>>>>>>[
+-<<<<<<+>>>>>>]<<<<<<[->>>>>>>+>>>>>>+<<<<<<<<<<<<<]>>>>>>>>>>>>>[-<<<<<
+<<<<<<<<+>>>>>>>>>>>>>]<<<<<++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<<<]>[-
+]<<[-]<<[-]>>>>>[-<<<<<+>>>>>]>[-<<<<+>>>>]<<<<<<<<<<[-]>>>>>>[-<<<<<<+>
+>>>>>]<<<<<<[->>>>>>>+>>>>>>+<<<<<<<<<<<<<]>>>>>>>>>>>>>[-<<<<<<<<<<<<<+
+>>>>>>>>>>>>>]<<<<<++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<<<]>[-]<<[-]<[-
+]>>>>[-<<<<+>>>>]>[-<<<<+>>>>]<<<<<<<<<<[-]>>>>>>[-<<<<<<+>>>>>>]<<<<<<[
+-]>>>>>[->+>+<<]>>[-<<+>>]<<<<<<<[->>>>>>+>+<<<<<<<]>>>>>>>[-<<<<<<<+>>>
+>>>>]<[->+>+<<]>>[-<<+>>]<[[-]<<++++++++++++++++++++++++++++++++++++++++
+++++++++.------------------------------------------------<<<<<[-]+>>>>>>
+>]<[-]<[-]<[->>+>+<<<]>>>[-<<<+>>>]<<<<<<<[->>>>>>+>+<<<<<<<]>>>>>>>[-<<
+<<<<<+>>>>>>>]<[->+>+<<]>>[-<<+>>]<[[-]<<<++++++++++++++++++++++++++++++
+++++++++++++++++++.------------------------------------------------<<<<[
+-]+>>>>>>>]<[-]<<[-]<[->>>+>+<<<<]>>>>[-<<<<+>>>>]<<<<<<<[->>>>>>+>+<<<<
+<<<]>>>>>>>[-<<<<<<<+>>>>>>>]<[->+>+<<]>>[-<<+>>]<[[-]<<<<++++++++++++++
+++++++++++++++++++++++++++++++++++.-------------------------------------
+-----------<<<[-]+>>>>>>>]<[-]<<<[-]<[->>>>+>+<<<<<]>>>>>[-<<<<<+>>>>>]<
+<<<<<<[->>>>>>+>+<<<<<<<]>>>>>>>[-<<<<<<<+>>>>>>>]<[->+>+<<]>>[-<<+>>]<[
+[-]<<<<<++++++++++++++++++++++++++++++++++++++++++++++++.---------------
+---------------------------------<<[-]+>>>>>>>]<[-]<<<<[-]<+++++++++++++
++++++++++++++++++++++++++++++++++++.------------------------------------
+------------[-]<[-]++++++++++.[-]<]<<<<<<<<<<<<<<[-]<<+>]<[-]>>>[-]
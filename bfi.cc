@@ -1,44 +1,219 @@
-#include <unordered_set>
-#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <cassert>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <string>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <stdexcept>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bytecode.hpp"
+#include "bytecode_cache.hpp"
+#include "emit_c.hpp"
+#include "emit_llvm.hpp"
+#include "interpreter.hpp"
+#include "io.hpp"
+#include "lockstep.hpp"
+#include "loop_detector.hpp"
+#include "metrics.hpp"
+#include "profile.hpp"
+#include "source.hpp"
+#include "superinstructions.hpp"
+#include "tape.hpp"
+#include "trace.hpp"
 
-
-using Word = uint32_t;
 const size_t kDefaultMaxSteps = 10 * 1000 * 1000;
+const size_t kSuperinstructionWarmupOps = 1 << 20;
+const size_t kTraceBytes = 16 << 20;
+const int kTraceSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGINT, SIGTERM};
+
+// The trace --trace records and the file it goes to, for the handler of the
+// signals that end the run.
+TraceRecorder* signal_trace = nullptr;
+int signal_trace_fd = -1;
+
+void request_checkpoint(int) {
+    checkpoint_requested = 1;
+}
+
+void write_trace_on_signal(int signal) {
+    signal_trace->set_signal(signal);
+    signal_trace->write(signal_trace_fd);
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
 
 void print_usage(const std::string& program_name) {
-    std::cerr << "Usage: " << program_name << " [--nocomments|-nc] <filename> [max_steps]" << std::endl;
+    std::cerr << "Usage: " << program_name << " [--nocomments|-nc] [--stats] [--metrics=FILE] [--profile] [--trace FILE] [--detect-loops] [--engine=switch|threaded|jit|tiered] [--cell-bits=8|16|32|64] [--eof=error|zero|unchanged] [--line-buffered] [--superinstructions] [--emit-c out.c] [--emit-llvm out.ll] [--checkpoint FILE [--checkpoint-every N]] [--resume FILE] [--cache DIR] [--batch LIST] <filename> [max_steps]" << std::endl;
     std::cerr << "Options:" << std::endl;
     std::cerr << "  --nocomments, -nc    Don't ignore comments (parts of code after # character)" << std::endl;
+    std::cerr << "  --stats              Print executed steps and peak tape use to stderr" << std::endl;
+    std::cerr << "  --metrics=FILE       Write steps, time, tape and I/O use and the loop nesting and ops the run" << std::endl;
+    std::cerr << "                       reached to FILE as JSON, also when the run fails" << std::endl;
+    std::cerr << "  --profile            Print the bfs comments that used most steps to stderr" << std::endl;
+    std::cerr << "  --trace FILE         Record loop entries, iterations and exits with the tape pointer and write" << std::endl;
+    std::cerr << "                       the last 16 MiB of them to FILE when the run ends or is killed; read" << std::endl;
+    std::cerr << "                       it with bfi_trace" << std::endl;
+    std::cerr << "  --detect-loops       Fail when a loop comes back to a state it was in before, which proves" << std::endl;
+    std::cerr << "                       that it never ends; runs with the threaded engine" << std::endl;
+    std::cerr << "  --engine=ENGINE      switch (default), threaded (computed goto dispatch) or" << std::endl;
+    std::cerr << "                       jit (x86-64 native code, max_steps checked at loop ends) or" << std::endl;
+    std::cerr << "                       tiered (switch, then jit for loops that run often)" << std::endl;
+    std::cerr << "  --cell-bits=BITS     Width of a tape cell: 8 (wraps at 256), 16, 32 (default) or 64;" << std::endl;
+    std::cerr << "                       the jit only runs 32-bit cells and uses threaded otherwise" << std::endl;
+    std::cerr << "  --eof=BEHAVIOR       What ',' stores at end of input: error (default), zero or unchanged" << std::endl;
+    std::cerr << "  --line-buffered      Flush output after every newline" << std::endl;
+    std::cerr << "  --superinstructions  With the threaded engine, fuse the op pairs that ran most during a" << std::endl;
+    std::cerr << "                       warm-up; --stats then also prints the hottest op sequences" << std::endl;
+    std::cerr << "  --emit-c FILE        Write the program as C source to FILE instead of running it" << std::endl;
+    std::cerr << "  --emit-llvm FILE     Write the program as LLVM IR to FILE instead of running it" << std::endl;
+    std::cerr << "  --checkpoint FILE    Save the interpreter state to FILE on SIGUSR1 (switch and threaded" << std::endl;
+    std::cerr << "                       engines; jit runs threaded)" << std::endl;
+    std::cerr << "  --checkpoint-every N Also save it every N steps" << std::endl;
+    std::cerr << "  --resume FILE        Continue the run saved in FILE; stdin must be the same input" << std::endl;
+    std::cerr << "  --cache DIR          Keep compiled programs in DIR and skip compiling them next time" << std::endl;
+    std::cerr << "  --batch LIST         Run the program once for every input file named in LIST, one per line," << std::endl;
+    std::cerr << "                       writing the output for FILE to FILE.out; up to 16 runs go in lockstep" << std::endl;
+    std::cerr << "                       and the engine finishes those that branch apart" << std::endl;
     std::cerr << "  max_steps            Maximum number of steps to execute (default: 1000000)" << std::endl;
 }
 
-class BrainfuckInterpreter {
-public:
-    BrainfuckInterpreter(std::string code);
-    // returns true if there are more step to run.
-    bool run_step();
-    // runs to the end.
-    void run(size_t max_steps);
-private:
-    std::string code_;
-    std::unordered_map<int, int> loop_start_to_end_;
-    std::unordered_map<int, int> loop_end_to_start_;
-    int ip_ = 0;
-    std::unordered_map<int, Word> tape_;
-    int tp_ = 0;
+// Settings for running the program, see print_usage().
+struct RunOptions {
+    std::string filename;
+    size_t max_steps = kDefaultMaxSteps;
+    bool print_stats = false;
+    std::string metrics_filename;
+    bool profile = false;
+    std::string trace_filename;
+    bool detect_loops = false;
+    Engine engine = Engine::kSwitch;
+    bool superinstructions = false;
+    std::string checkpoint_filename;
+    size_t checkpoint_every = 0;
+    std::string resume_filename;
+    std::string cache_directory;
 };
 
+// Filters and compiles source, see filter_source(), or loads the result from
+// cache_directory if an earlier run stored it there.
+std::vector<Op> compile_source(std::string_view source, bool strip_comments, const std::string& cache_directory) {
+    std::vector<Op> code;
+    if (!cache_directory.empty() && load_cached_bytecode(cache_directory, source, strip_comments, &code)) {
+        return code;
+    }
+    code = compile(filter_source(source, strip_comments));
+    if (!cache_directory.empty()) {
+        try {
+            save_cached_bytecode(cache_directory, source, strip_comments, code);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+    }
+    return code;
+}
+
+// Runs interpreter to the end with the engine options selects. Throws
+// std::runtime_error.
+template <typename Cell>
+void run_engine(BrainfuckInterpreter<Cell>* interpreter, const RunOptions& options, SuperinstructionPlan* plan) {
+    switch (options.engine) {
+        case Engine::kSwitch: interpreter->run(options.max_steps); break;
+        case Engine::kThreaded:
+            if (options.superinstructions) {
+                interpreter->run_superinstructions(options.max_steps, kSuperinstructionWarmupOps, plan);
+            } else {
+                interpreter->run_threaded(options.max_steps);
+            }
+            break;
+        case Engine::kJit: interpreter->run_jit(options.max_steps); break;
+        case Engine::kTiered: interpreter->run_tiered(options.max_steps); break;
+    }
+}
+
+const char* engine_name(Engine engine) {
+    switch (engine) {
+        case Engine::kSwitch: return "switch";
+        case Engine::kThreaded: return "threaded";
+        case Engine::kJit: return "jit";
+        case Engine::kTiered: return "tiered";
+    }
+    return "unknown";
+}
+
+// Writes the --metrics of interpreter's run, which started at start as engine
+// and stopped with error, or finished if error is empty. Returns false if
+// the file could not be written.
+template <typename Cell>
+bool write_metrics(const RunOptions& options, const std::string& engine, BrainfuckInterpreter<Cell>* interpreter,
+                   const BufferedIo& io, std::chrono::steady_clock::time_point start, const std::string& error) {
+    if (options.metrics_filename.empty()) {
+        return true;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    RunMetrics metrics;
+    metrics.program = options.filename;
+    metrics.engine = engine;
+    metrics.cell_bits = 8 * sizeof(Cell);
+    metrics.error = error;
+    metrics.steps = interpreter->steps();
+    metrics.seconds = elapsed.count();
+    BasicTape<Cell>& tape = interpreter->mutable_tape();
+    metrics.peak_begin = tape.begin_index();
+    metrics.peak_end = tape.end_index();
+    const Cell* cells = tape.zero_cell();
+    int final_begin = tape.begin_index();
+    int final_end = tape.end_index();
+    while (final_begin < final_end && cells[final_begin] == 0) {
+        final_begin++;
+    }
+    while (final_end > final_begin && cells[final_end - 1] == 0) {
+        final_end--;
+    }
+    if (final_begin == final_end) {
+        final_begin = final_end = 0;
+    }
+    metrics.final_begin = final_begin;
+    metrics.final_end = final_end;
+    metrics.tape_pointer = interpreter->tape_pointer();
+    metrics.input_bytes = io.input_offset();
+    metrics.output_bytes = io.output_offset();
+    metrics.set_ops(interpreter->code(), interpreter->block_counts());
+    try {
+        metrics.write(options.metrics_filename);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Runs source with Cell cells and returns the exit code.
+template <typename Cell>
+int run_program(std::string_view source, bool strip_comments, const RunOptions& options, BufferedIo* io);
+// Runs source on every file in inputs, see --batch, and returns the exit code.
+template <typename Cell>
+int run_batch(std::string_view source, bool strip_comments, const RunOptions& options, EofBehavior eof,
+              const std::vector<std::string>& inputs);
+
 int main(int argc, const char * argv[]) {
-    std::string code;
-    size_t max_steps = kDefaultMaxSteps;
+    RunOptions options;
     bool ignore_comments = true;
+    int cell_bits = 32;
+    EofBehavior eof = EofBehavior::kError;
+    bool line_buffered = false;
+    std::string emit_c_filename;
+    std::string emit_llvm_filename;
+    std::string batch_filename;
+    // Whether --engine was given, for --detect-loops, which runs threaded
+    // instead of the default.
+    bool engine_chosen = false;
     std::string filename;
     
     // Parse command-line arguments
@@ -46,13 +221,99 @@ int main(int argc, const char * argv[]) {
         std::string arg = argv[i];
         if (arg == "--nocomments" || arg == "-nc") {
             ignore_comments = false;
+        } else if (arg == "--stats") {
+            options.print_stats = true;
+        } else if (arg.rfind("--metrics=", 0) == 0 && arg.size() > 10) {
+            options.metrics_filename = arg.substr(10);
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--detect-loops") {
+            options.detect_loops = true;
+        } else if (arg == "--engine=switch") {
+            options.engine = Engine::kSwitch;
+            engine_chosen = true;
+        } else if (arg == "--engine=threaded") {
+            options.engine = Engine::kThreaded;
+            engine_chosen = true;
+        } else if (arg == "--engine=jit") {
+            options.engine = Engine::kJit;
+            engine_chosen = true;
+        } else if (arg == "--engine=tiered") {
+            options.engine = Engine::kTiered;
+            engine_chosen = true;
+        } else if (arg == "--cell-bits=8") {
+            cell_bits = 8;
+        } else if (arg == "--cell-bits=16") {
+            cell_bits = 16;
+        } else if (arg == "--cell-bits=32") {
+            cell_bits = 32;
+        } else if (arg == "--cell-bits=64") {
+            cell_bits = 64;
+        } else if (arg == "--eof=error") {
+            eof = EofBehavior::kError;
+        } else if (arg == "--eof=zero") {
+            eof = EofBehavior::kZero;
+        } else if (arg == "--eof=unchanged") {
+            eof = EofBehavior::kUnchanged;
+        } else if (arg == "--line-buffered") {
+            line_buffered = true;
+        } else if (arg == "--superinstructions") {
+            options.superinstructions = true;
+        } else if (arg == "--emit-c") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            emit_c_filename = argv[++i];
+        } else if (arg == "--emit-llvm") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            emit_llvm_filename = argv[++i];
+        } else if (arg == "--cache") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.cache_directory = argv[++i];
+        } else if (arg == "--trace") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.trace_filename = argv[++i];
+        } else if (arg == "--batch") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            batch_filename = argv[++i];
+        } else if (arg == "--checkpoint" || arg == "--resume") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            (arg == "--checkpoint" ? options.checkpoint_filename : options.resume_filename) = argv[++i];
+        } else if (arg == "--checkpoint-every") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            try {
+                options.checkpoint_every = std::stoull(argv[++i]);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid --checkpoint-every value: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
         } else if (filename.empty()) {
             // First non-option argument is the filename
             filename = arg;
         } else {
             // Second non-option argument is max_steps
             try {
-                max_steps = std::stoull(arg);
+                options.max_steps = std::stoull(arg);
             } catch (const std::exception& e) {
                 std::cerr << "Error: Invalid max_steps value: " << arg << std::endl;
                 print_usage(argv[0]);
@@ -65,113 +326,291 @@ int main(int argc, const char * argv[]) {
         print_usage(argv[0]);
         return 1;
     }
+    options.filename = filename;
     
-    std::ifstream file(filename);
+    SourceFile file(filename);
     if (!file.is_open()) {
         std::cerr << "Error: Could not open file " << filename << std::endl;
         return 1;
     }
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string raw_code = buffer.str();
-    
-    // Process the code to handle comments if needed
-    if (ignore_comments) {
-        for (size_t i = 0; i < raw_code.length(); ++i) {
-            if (raw_code[i] == '#') {
-                // Skip until end of line or end of file
-                while (i < raw_code.length() && raw_code[i] != '\n') {
-                    ++i;
-                }
-                if (i >= raw_code.length()) break;
-                if (raw_code[i] == '\n') {
-                    code += raw_code[i];  // Keep the newline character
-                }
-            } else {
-                code += raw_code[i];
-            }
+
+    if ((!emit_c_filename.empty() || !emit_llvm_filename.empty()) && cell_bits != 32) {
+        std::cerr << "Error: --emit-c and --emit-llvm only support 32-bit cells" << std::endl;
+        return 1;
+    }
+    if (!emit_c_filename.empty()) {
+        std::ofstream output(emit_c_filename);
+        if (!output) {
+            std::cerr << "Error: Could not open output file " << emit_c_filename << std::endl;
+            return 1;
         }
-    } else {
-        code = raw_code;
+        emit_c(compile_source(file.contents(), ignore_comments, options.cache_directory), filename, eof, output);
+        return 0;
+    }
+    if (!emit_llvm_filename.empty()) {
+        std::ofstream output(emit_llvm_filename);
+        if (!output) {
+            std::cerr << "Error: Could not open output file " << emit_llvm_filename << std::endl;
+            return 1;
+        }
+        emit_llvm(compile_source(file.contents(), ignore_comments, options.cache_directory), filename, eof, output);
+        return 0;
     }
-    
-    BrainfuckInterpreter interpreter(code);
-    interpreter.run(max_steps);
-
-    return 0;
-}
 
-BrainfuckInterpreter::BrainfuckInterpreter(std::string code) {
-    static const std::unordered_set<char>* kBfTokens = new std::unordered_set<char>{'.', ',', '+', '-', '<', '>', '[', ']'};
-    std::vector<int> loop_starts;
-    int ip = 0;
-    while(ip < code.size()) {
-        if (code.substr(ip, 3) == "[-]") {
-            code_.push_back('z');
-            ip+=3;
-            continue;
-        }
-        char t = code[ip++];
-        if (kBfTokens->find(t) != kBfTokens->end()) {
-            code_.push_back(t);
-            if (t == '[') {
-                loop_starts.push_back(code_.size());
-            }
-            if (t == ']') {
-                if (loop_starts.empty()) {
-                    throw std::invalid_argument("unmatched loop end at pos " + std::to_string(ip));
-                }
-                int start = loop_starts.back();
-                loop_starts.pop_back();
-                int end = code_.size();
-                loop_start_to_end_[start] = end;
-                loop_end_to_start_[end] = start - 1;
+    if (!batch_filename.empty()) {
+        if (options.profile || options.detect_loops || !options.trace_filename.empty() ||
+            !options.checkpoint_filename.empty() || !options.resume_filename.empty() ||
+            !options.metrics_filename.empty()) {
+            std::cerr << "Error: --batch cannot be combined with --profile, --detect-loops, --trace, --checkpoint, "
+                         "--resume or --metrics"
+                      << std::endl;
+            return 1;
+        }
+        std::ifstream list(batch_filename);
+        if (!list) {
+            std::cerr << "Error: Could not open file " << batch_filename << std::endl;
+            return 1;
+        }
+        std::vector<std::string> inputs;
+        for (std::string line; std::getline(list, line);) {
+            if (!line.empty()) {
+                inputs.push_back(line);
             }
         }
+        switch (cell_bits) {
+            case 8: return run_batch<uint8_t>(file.contents(), ignore_comments, options, eof, inputs);
+            case 16: return run_batch<uint16_t>(file.contents(), ignore_comments, options, eof, inputs);
+            case 64: return run_batch<uint64_t>(file.contents(), ignore_comments, options, eof, inputs);
+            default: return run_batch<uint32_t>(file.contents(), ignore_comments, options, eof, inputs);
+        }
+    }
+
+    // The cache does not keep the debug info that --profile, --trace and
+    // --detect-loops need.
+    if (options.profile && (!options.checkpoint_filename.empty() || !options.resume_filename.empty() ||
+                            !options.cache_directory.empty())) {
+        std::cerr << "Error: --profile cannot be combined with --checkpoint, --resume or --cache" << std::endl;
+        return 1;
+    }
+    if (!options.trace_filename.empty() &&
+        (options.profile || options.detect_loops || options.engine != Engine::kSwitch || options.superinstructions ||
+         !options.checkpoint_filename.empty() || !options.resume_filename.empty() || !options.cache_directory.empty())) {
+        std::cerr << "Error: --trace cannot be combined with --profile, --detect-loops, an --engine other than "
+                     "switch, --superinstructions, --checkpoint, --resume or --cache"
+                  << std::endl;
+        return 1;
+    }
+    if (options.detect_loops &&
+        (options.profile || (engine_chosen && options.engine != Engine::kThreaded) || options.superinstructions ||
+         !options.checkpoint_filename.empty() || !options.resume_filename.empty() ||
+         !options.cache_directory.empty())) {
+        std::cerr << "Error: --detect-loops cannot be combined with --profile, an --engine other than threaded, "
+                     "--superinstructions, --checkpoint, --resume or --cache"
+                  << std::endl;
+        return 1;
+    }
+    BufferedIo io(STDIN_FILENO, STDOUT_FILENO, eof, line_buffered);
+    switch (cell_bits) {
+        case 8: return run_program<uint8_t>(file.contents(), ignore_comments, options, &io);
+        case 16: return run_program<uint16_t>(file.contents(), ignore_comments, options, &io);
+        case 64: return run_program<uint64_t>(file.contents(), ignore_comments, options, &io);
+        default: return run_program<uint32_t>(file.contents(), ignore_comments, options, &io);
     }
 }
 
-bool BrainfuckInterpreter::run_step() {
-    if (ip_ >= code_.size()) {
-        return false;
+template <typename Cell>
+int run_program(std::string_view source, bool strip_comments, const RunOptions& options, BufferedIo* io) {
+    auto start = std::chrono::steady_clock::now();
+    if (options.profile) {
+        std::vector<size_t> instruction_offsets;
+        std::string code = filter_source(source, strip_comments, &instruction_offsets);
+        DebugInfo debug_info;
+        std::vector<Op> ops = compile(code, &debug_info);
+        Profile profile(source, instruction_offsets, ops, debug_info);
+        BrainfuckInterpreter<Cell> interpreter(ops, io);
+        try {
+            interpreter.run_profiled(options.max_steps, &profile);
+        } catch (const std::runtime_error& e) {
+            io->flush();
+            profile.print(std::cerr);
+            std::cerr << "Error: " << e.what() << std::endl;
+            write_metrics(options, "profile", &interpreter, *io, start, e.what());
+            return 1;
+        }
+        io->flush();
+        profile.print(std::cerr);
+        return write_metrics(options, "profile", &interpreter, *io, start, "") ? 0 : 1;
     }
-    switch (code_[ip_++]) {
-        case '.': std::cout << static_cast<char>(tape_[tp_]) << std::flush; break;
-        case ',': {
-            int ch = getchar();
-            if (ch == EOF) {
-                std::cerr << "Error: No input available from stdin" << std::endl;
-                exit(1);
-            }
-            tape_[tp_] = ch;
-            break;
+    if (!options.trace_filename.empty()) {
+        // Like the profile, the trace needs debug info to name the loops.
+        std::vector<size_t> instruction_offsets;
+        std::string code = filter_source(source, strip_comments, &instruction_offsets);
+        DebugInfo debug_info;
+        std::vector<Op> ops = compile(code, &debug_info);
+        int fd = ::open(options.trace_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "Error: Could not open trace file " << options.trace_filename << std::endl;
+            return 1;
         }
-        case '+': tape_[tp_]++; break;
-        case '-': tape_[tp_]--; break;
-        case 'z': tape_[tp_] = 0; break;
-        case '>': tp_++; break;
-        case '<': tp_--; break;
-        case '[': if (tape_[tp_] == 0) {
-                ip_ = loop_start_to_end_.at(ip_);
-            }
-            break;
-        case ']': ip_ = loop_end_to_start_.at(ip_);
-            break;
-        default:
-            throw std::runtime_error("unexpected token" + code_.substr(ip_ -1, 1));
+        TraceRecorder trace(kTraceBytes, source, instruction_offsets, ops, debug_info);
+        BrainfuckInterpreter<Cell> interpreter(ops, io);
+        signal_trace = &trace;
+        signal_trace_fd = fd;
+        for (int signal : kTraceSignals) {
+            std::signal(signal, write_trace_on_signal);
+        }
+        std::string error;
+        try {
+            interpreter.run_traced(options.max_steps, &trace);
+        } catch (const std::runtime_error& e) {
+            error = e.what();
+        }
+        io->flush();
+        for (int signal : kTraceSignals) {
+            std::signal(signal, SIG_DFL);
+        }
+        signal_trace = nullptr;
+        trace.set_end(error.empty() ? TraceRecorder::EndReason::kFinished : TraceRecorder::EndReason::kError,
+                      interpreter.steps(), interpreter.tape_pointer(), error);
+        bool failed = !error.empty();
+        if (failed) {
+            std::cerr << "Error: " << error << std::endl;
+        }
+        bool written = trace.write(fd);
+        if (::close(fd) != 0 || !written) {
+            std::cerr << "Error: Could not write trace file " << options.trace_filename << std::endl;
+            failed = true;
+        }
+        if (!write_metrics(options, "trace", &interpreter, *io, start, error)) {
+            failed = true;
+        }
+        return failed ? 1 : 0;
     }
-    return true;
+    if (options.detect_loops) {
+        // Like the profile, the detector needs debug info to report where
+        // the loop is.
+        std::vector<size_t> instruction_offsets;
+        std::string code = filter_source(source, strip_comments, &instruction_offsets);
+        DebugInfo debug_info;
+        std::vector<Op> ops = compile(code, &debug_info);
+        LoopDetector detector(source, instruction_offsets, ops, debug_info);
+        BrainfuckInterpreter<Cell> interpreter(ops, io);
+        try {
+            interpreter.run_detecting(options.max_steps, &detector);
+        } catch (const std::runtime_error& e) {
+            io->flush();
+            std::cerr << "Error: " << e.what() << std::endl;
+            write_metrics(options, "detect-loops", &interpreter, *io, start, e.what());
+            return 1;
+        }
+        io->flush();
+        return write_metrics(options, "detect-loops", &interpreter, *io, start, "") ? 0 : 1;
+    }
+    BrainfuckInterpreter<Cell> interpreter(compile_source(source, strip_comments, options.cache_directory), io);
+    if (!options.resume_filename.empty()) {
+        try {
+            interpreter.resume(options.resume_filename);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            write_metrics(options, engine_name(options.engine), &interpreter, *io, start, e.what());
+            return 1;
+        }
+    }
+    if (!options.checkpoint_filename.empty()) {
+        interpreter.enable_checkpoints(options.checkpoint_filename, options.checkpoint_every);
+        std::signal(SIGUSR1, request_checkpoint);
+    }
+    SuperinstructionPlan plan;
+    try {
+        run_engine(&interpreter, options, &plan);
+    } catch (const std::runtime_error& e) {
+        io->flush();
+        std::cerr << "Error: " << e.what() << std::endl;
+        write_metrics(options, engine_name(options.engine), &interpreter, *io, start, e.what());
+        return 1;
+    }
+    io->flush();
+    if (options.print_stats) {
+        if (options.superinstructions && options.engine == Engine::kThreaded) {
+            plan.print(std::cerr);
+        }
+        const BasicTape<Cell>& tape = interpreter.tape();
+        std::cerr << "steps: " << interpreter.steps() << std::endl;
+        std::cerr << "peak tape: " << tape.peak_cells() << " cells (" << tape.peak_pages() << " pages, cells "
+                  << tape.begin_index() << ".." << tape.end_index() - 1 << ")" << std::endl;
+    }
+
+    return write_metrics(options, engine_name(options.engine), &interpreter, *io, start, "") ? 0 : 1;
 }
 
-void BrainfuckInterpreter::run(size_t max_steps) {
+// One input of --batch: the program reads filename and writes filename.out.
+struct BatchRun {
+    BatchRun(const std::string& filename, EofBehavior eof)
+        : filename(filename),
+          input(filename, std::ios::binary),
+          output(filename + ".out", std::ios::binary),
+          io([this](char* data, size_t size) -> size_t {
+                 input.read(data, size);
+                 return input.gcount();
+             },
+             [this](const char* data, size_t size) { output.write(data, size); }, eof) {}
+
+    std::string filename;
+    std::ifstream input;
+    std::ofstream output;
+    BufferedIo io;
+};
+
+template <typename Cell>
+int run_batch(std::string_view source, bool strip_comments, const RunOptions& options, EofBehavior eof,
+              const std::vector<std::string>& inputs) {
+    std::vector<Op> code = compile_source(source, strip_comments, options.cache_directory);
+    const size_t lanes = LockstepInterpreter<Cell>::kLanes;
+    int result = 0;
     size_t steps = 0;
-    while(run_step()) {
-        steps++;
-        if (steps >= max_steps) {
-            std::cerr << "Error: Maximum steps (" << max_steps << ") reached" << std::endl;
-            exit(1);
+    size_t diverged = 0;
+    for (size_t first = 0; first < inputs.size(); first += lanes) {
+        std::vector<std::unique_ptr<BatchRun>> runs;
+        std::vector<BufferedIo*> ios;
+        for (size_t i = first; i < std::min(first + lanes, inputs.size()); i++) {
+            auto run = std::make_unique<BatchRun>(inputs[i], eof);
+            if (!run->input || !run->output) {
+                std::cerr << "Error: Could not open file " << inputs[i] << " or " << inputs[i] << ".out" << std::endl;
+                result = 1;
+                continue;
+            }
+            ios.push_back(&run->io);
+            runs.push_back(std::move(run));
         }
+        LockstepInterpreter<Cell> lockstep(code, ios);
+        lockstep.run(options.max_steps);
+        for (size_t lane = 0; lane < runs.size(); lane++) {
+            BatchRun& run = *runs[lane];
+            std::string error = lockstep.error(lane);
+            size_t lane_steps = lockstep.steps(lane);
+            if (lockstep.state(lane) == LockstepInterpreter<Cell>::LaneState::kDiverged) {
+                diverged++;
+                BrainfuckInterpreter<Cell> interpreter(code, &run.io);
+                lockstep.hand_over(lane, &interpreter);
+                SuperinstructionPlan plan;
+                try {
+                    run_engine(&interpreter, options, &plan);
+                } catch (const std::runtime_error& e) {
+                    error = e.what();
+                }
+                lane_steps = interpreter.steps();
+            }
+            run.io.flush();
+            steps += lane_steps;
+            if (!error.empty()) {
+                std::cerr << "Error: " << run.filename << ": " << error << std::endl;
+                result = 1;
+            }
+        }
+    }
+    if (options.print_stats) {
+        std::cerr << "steps: " << steps << std::endl;
+        std::cerr << "diverged: " << diverged << " of " << inputs.size() << " runs" << std::endl;
     }
+    return result;
 }
-
@@ -0,0 +1,183 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+#include "interpreter.hpp"
+#include "io.hpp"
+#include "source.hpp"
+#include "superinstructions.hpp"
+
+// Runs every program of a fixed corpus with every engine and prints how fast
+// each one went, so engine changes can be compared on the same numbers.
+
+const size_t kDefaultMaxSteps = 100ull * 1000 * 1000 * 1000;
+const size_t kDefaultRepeat = 3;
+const size_t kSuperinstructionWarmupOps = 1 << 20;
+
+// The rows of the report, in the order they run. The first one's output is
+// what the others are checked against.
+struct BenchEngine {
+    const char* name;
+    Engine engine;
+    bool superinstructions;
+};
+
+const BenchEngine kEngines[] = {
+    {"switch", Engine::kSwitch, false},
+    {"threaded", Engine::kThreaded, false},
+    {"superinstructions", Engine::kThreaded, true},
+    {"jit", Engine::kJit, false},
+    {"tiered", Engine::kTiered, false},
+};
+
+struct BenchResult {
+    size_t steps = 0;
+    double seconds = std::numeric_limits<double>::infinity();
+    size_t peak_cells = 0;
+    uint64_t checksum = 0;
+};
+
+void print_usage(const std::string& program_name) {
+    std::cerr << "Usage: " << program_name << " [--repeat N] [--max-steps N] <filename>..." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --repeat N       Run every program N times per engine and keep the fastest (default: 3)" << std::endl;
+    std::cerr << "  --max-steps N    Fail a program that runs more steps (default: 100000000000)" << std::endl;
+    std::cerr << "Programs run with 32-bit cells and no input. Exits with 1 if a program fails or an" << std::endl;
+    std::cerr << "engine's output differs from the switch engine's." << std::endl;
+}
+
+// Runs code once with bench_engine and returns what it did. Throws
+// std::runtime_error.
+BenchResult run_once(const std::vector<Op>& code, const BenchEngine& bench_engine, size_t max_steps) {
+    // FNV-1a over the output, so no output needs to be kept.
+    uint64_t checksum = 0xCBF29CE484222325ull;
+    BufferedIo io([](char*, size_t) -> size_t { return 0; },
+                  [&checksum](const char* data, size_t size) {
+                      for (size_t i = 0; i < size; i++) {
+                          checksum = (checksum ^ static_cast<unsigned char>(data[i])) * 0x100000001B3ull;
+                      }
+                  },
+                  EofBehavior::kZero);
+    BrainfuckInterpreter<uint32_t> interpreter(code, &io);
+    SuperinstructionPlan plan;
+    auto start = std::chrono::steady_clock::now();
+    switch (bench_engine.engine) {
+        case Engine::kSwitch: interpreter.run(max_steps); break;
+        case Engine::kThreaded:
+            if (bench_engine.superinstructions) {
+                interpreter.run_superinstructions(max_steps, kSuperinstructionWarmupOps, &plan);
+            } else {
+                interpreter.run_threaded(max_steps);
+            }
+            break;
+        case Engine::kJit: interpreter.run_jit(max_steps); break;
+        case Engine::kTiered: interpreter.run_tiered(max_steps); break;
+    }
+    io.flush();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    BenchResult result;
+    result.steps = interpreter.steps();
+    result.seconds = elapsed.count();
+    result.peak_cells = interpreter.tape().peak_cells();
+    result.checksum = checksum;
+    return result;
+}
+
+void print_header() {
+    std::cout << std::left << std::setw(24) << "program" << std::setw(19) << "engine" << std::right
+              << std::setw(14) << "steps" << std::setw(11) << "ms" << std::setw(11) << "Msteps/s"
+              << std::setw(9) << "ns/step" << std::setw(12) << "peak cells" << "  checksum" << std::endl;
+}
+
+void print_row(const std::string& program, const BenchEngine& bench_engine, const BenchResult& result,
+               bool mismatch) {
+    char checksum[17];
+    std::snprintf(checksum, sizeof(checksum), "%016llx", static_cast<unsigned long long>(result.checksum));
+    double steps = static_cast<double>(result.steps);
+    std::cout << std::left << std::setw(24) << program << std::setw(19) << bench_engine.name << std::right
+              << std::fixed << std::setw(14) << result.steps << std::setprecision(1) << std::setw(11)
+              << result.seconds * 1e3 << std::setw(11) << steps / result.seconds / 1e6 << std::setprecision(2)
+              << std::setw(9) << result.seconds * 1e9 / steps << std::setw(12) << result.peak_cells << "  "
+              << checksum << (mismatch ? "  MISMATCH" : "") << std::endl;
+}
+
+int main(int argc, const char * argv[]) {
+    size_t repeat = kDefaultRepeat;
+    size_t max_steps = kDefaultMaxSteps;
+    std::vector<std::string> filenames;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" || arg == "--max-steps") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            try {
+                (arg == "--repeat" ? repeat : max_steps) = std::stoull(argv[++i]);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid " << arg << " value: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else {
+            filenames.push_back(arg);
+        }
+    }
+    if (filenames.empty() || repeat == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    bool failed = false;
+    print_header();
+    for (const std::string& filename : filenames) {
+        SourceFile file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open file " << filename << std::endl;
+            failed = true;
+            continue;
+        }
+        std::string program = filename.substr(filename.find_last_of('/') + 1);
+        std::vector<Op> code;
+        try {
+            code = compile(filter_source(file.contents(), true));
+        } catch (const std::invalid_argument& e) {
+            std::cerr << "Error: " << program << ": " << e.what() << std::endl;
+            failed = true;
+            continue;
+        }
+        bool has_reference = false;
+        uint64_t reference = 0;
+        for (const BenchEngine& bench_engine : kEngines) {
+            BenchResult best;
+            try {
+                for (size_t i = 0; i < repeat; i++) {
+                    BenchResult result = run_once(code, bench_engine, max_steps);
+                    if (result.seconds < best.seconds) {
+                        best = result;
+                    }
+                }
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Error: " << program << " with " << bench_engine.name << ": " << e.what() << std::endl;
+                failed = true;
+                continue;
+            }
+            if (!has_reference) {
+                has_reference = true;
+                reference = best.checksum;
+            }
+            bool mismatch = best.checksum != reference;
+            failed = failed || mismatch;
+            print_row(program, bench_engine, best, mismatch);
+        }
+    }
+    return failed ? 1 : 0;
+}
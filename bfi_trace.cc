@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+
+// Prints a trace that bfi --trace wrote: how the run ended and then either
+// its events, oldest first, or how often each loop ran.
+
+// What the trace shows of one loop, for --summary.
+struct LoopSummary {
+    uint64_t entries = 0;
+    uint64_t skips = 0;
+    uint64_t iterations = 0;
+    uint64_t max_iterations = 0;
+};
+
+void print_usage(const std::string& program_name) {
+    std::cerr << "Usage: " << program_name << " [--summary] [--last N] <trace>" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --summary    Print the entries, skips and iterations of every loop instead of the events" << std::endl;
+    std::cerr << "  --last N     Print only the last N events" << std::endl;
+}
+
+std::string describe_loop(const std::map<size_t, TraceLoop>& loops, size_t loop) {
+    auto it = loops.find(loop);
+    if (it == loops.end()) {
+        return "loop " + std::to_string(loop);
+    }
+    return "loop " + std::to_string(loop) + " (line " + std::to_string(it->second.line) + ", column " +
+           std::to_string(it->second.column) + ")";
+}
+
+void print_end(const TraceFile& trace) {
+    switch (trace.reason) {
+        case TraceRecorder::EndReason::kFinished: std::cout << "ended: finished" << std::endl; break;
+        case TraceRecorder::EndReason::kError: std::cout << "ended: error: " << trace.message << std::endl; break;
+        case TraceRecorder::EndReason::kSignal: std::cout << "ended: signal " << trace.signal << std::endl; break;
+    }
+    std::cout << "steps: " << trace.steps << ", tape pointer: " << trace.tp << std::endl;
+    if (trace.dropped_chunks > 0) {
+        std::cout << "dropped: the events of the first " << trace.dropped_chunks
+                  << " chunks, which the ring buffer reused" << std::endl;
+    }
+}
+
+void print_event(const std::map<size_t, TraceLoop>& loops, const TraceEvent& event) {
+    switch (event.kind) {
+        case TraceRecorder::EventKind::kEnter: std::cout << "enter   "; break;
+        case TraceRecorder::EventKind::kIterate: std::cout << "iterate "; break;
+        case TraceRecorder::EventKind::kExit: std::cout << "exit    "; break;
+        case TraceRecorder::EventKind::kSkip: std::cout << "skip    "; break;
+    }
+    std::cout << describe_loop(loops, event.loop) << " at tp " << event.tp;
+    if (event.kind == TraceRecorder::EventKind::kExit) {
+        std::cout << " after " << event.iterations << " iterations";
+    }
+    std::cout << std::endl;
+}
+
+void print_summary(const std::map<size_t, TraceLoop>& loops, const TraceFile& trace) {
+    std::map<size_t, LoopSummary> summaries;
+    for (const TraceChunk& chunk : trace.chunks) {
+        for (const TraceEvent& event : chunk.events) {
+            LoopSummary& summary = summaries[event.loop];
+            switch (event.kind) {
+                case TraceRecorder::EventKind::kEnter: summary.entries++; break;
+                case TraceRecorder::EventKind::kIterate: break;
+                case TraceRecorder::EventKind::kExit:
+                    summary.iterations += event.iterations;
+                    summary.max_iterations = std::max(summary.max_iterations, event.iterations);
+                    break;
+                case TraceRecorder::EventKind::kSkip: summary.skips++; break;
+            }
+        }
+    }
+    std::vector<std::pair<size_t, LoopSummary>> sorted(summaries.begin(), summaries.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second.iterations > b.second.iterations;
+    });
+    std::cout << std::left << std::setw(40) << "loop" << std::right << std::setw(12) << "entries" << std::setw(12)
+              << "skips" << std::setw(16) << "iterations" << std::setw(16) << "max iterations" << std::endl;
+    for (const auto& [loop, summary] : sorted) {
+        std::cout << std::left << std::setw(40) << describe_loop(loops, loop) << std::right << std::setw(12)
+                  << summary.entries << std::setw(12) << summary.skips << std::setw(16) << summary.iterations
+                  << std::setw(16) << summary.max_iterations << std::endl;
+    }
+    std::cout << "Iterations only count the loop exits in the trace." << std::endl;
+}
+
+int main(int argc, const char * argv[]) {
+    bool summary = false;
+    size_t last = 0;
+    std::string filename;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--summary") {
+            summary = true;
+        } else if (arg == "--last") {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            try {
+                last = std::stoull(argv[++i]);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid --last value: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (filename.empty()) {
+            filename = arg;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (filename.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    TraceFile trace;
+    try {
+        trace = read_trace(filename);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::map<size_t, TraceLoop> loops(trace.loops.begin(), trace.loops.end());
+    print_end(trace);
+    if (summary) {
+        print_summary(loops, trace);
+        return 0;
+    }
+    size_t events = 0;
+    for (const TraceChunk& chunk : trace.chunks) {
+        events += chunk.events.size();
+    }
+    size_t skipped = last == 0 ? 0 : events - std::min(last, events);
+    for (const TraceChunk& chunk : trace.chunks) {
+        if (skipped >= chunk.events.size()) {
+            skipped -= chunk.events.size();
+            continue;
+        }
+        std::cout << "-- chunk started at step " << chunk.steps << " --" << std::endl;
+        for (size_t i = skipped; i < chunk.events.size(); i++) {
+            print_event(loops, chunk.events[i]);
+        }
+        skipped = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,352 @@
+#include "bytecode.hpp"
+#include <map>
+#include <set>
+#include <stdexcept>
+
+namespace {
+bool is_foldable(char c, OpCode* code, int* delta) {
+    switch (c) {
+        case '+': *code = OpCode::kAdd; *delta = 1; return true;
+        case '-': *code = OpCode::kAdd; *delta = -1; return true;
+        case '>': *code = OpCode::kMove; *delta = 1; return true;
+        case '<': *code = OpCode::kMove; *delta = -1; return true;
+        default: return false;
+    }
+}
+
+// Replaces the loop starting at ops[start] with multiply-adds if its body only
+// adds and moves, returns to the loop cell and decrements it by exactly one.
+bool lower_mul_loop(std::vector<Op>* ops, size_t start) {
+    std::map<int, int> deltas;
+    int pos = 0;
+    uint32_t body_cost = 0;
+    for (size_t i = start + 1; i < ops->size(); i++) {
+        const Op& op = (*ops)[i];
+        switch (op.code) {
+            case OpCode::kAdd: deltas[pos] += op.arg; break;
+            case OpCode::kMove: pos += op.arg; break;
+            default: return false;
+        }
+        body_cost += op.cost;
+    }
+    if (pos != 0 || deltas[0] != -1) {
+        return false;
+    }
+    ops->resize(start);
+    for (const auto& [offset, factor] : deltas) {
+        if (offset != 0 && factor != 0) {
+            ops->push_back(Op{OpCode::kMulAdd, factor, offset, 0});
+        }
+    }
+    // Every iteration costs the body plus the closing and re-tested opening
+    // bracket; the clear itself pays for the final test.
+    ops->push_back(Op{OpCode::kClear, 0, 0, 1, body_cost + 2});
+    return true;
+}
+
+// Replaces a loop whose body is a single move, like [>] or [<<], by a scan.
+bool lower_scan_loop(std::vector<Op>* ops, size_t start) {
+    if (ops->size() != start + 2) {
+        return false;
+    }
+    const Op& body = (*ops)[start + 1];
+    if (body.code != OpCode::kMove || body.arg == 0) {
+        return false;
+    }
+    Op scan{OpCode::kScan, body.arg, 0, 1, body.cost + 2};
+    ops->resize(start);
+    ops->push_back(scan);
+    return true;
+}
+
+bool in_straight_run(const Op& op) {
+    return op.code == OpCode::kAdd || op.code == OpCode::kMove ||
+           (op.code == OpCode::kClear && op.iteration_cost == 0);
+}
+
+// Appends the ops for run, a run of adds, moves and plain clears, to result.
+// Steps that no emitted op stands for, like those of "+-" or "<>", are added
+// to *carried_cost for the next op.
+void address_run_by_offset(const Op* run, size_t length, const size_t* run_positions, std::vector<Op>* result,
+                           std::vector<size_t>* positions, uint32_t* carried_cost) {
+    struct CellEffect {
+        bool clear = false;
+        uint32_t delta = 0;
+        uint32_t cost = 0;
+        size_t position = 0;
+    };
+    std::map<int, CellEffect> cells;
+    int pos = 0;
+    uint32_t move_cost = 0;
+    size_t move_position = run_positions[0];
+    for (size_t i = 0; i < length; i++) {
+        const Op& op = run[i];
+        if (op.code == OpCode::kMove) {
+            pos += op.arg;
+            move_cost += op.cost;
+            move_position = run_positions[i];
+            continue;
+        }
+        auto [it, inserted] = cells.try_emplace(pos);
+        CellEffect& cell = it->second;
+        if (inserted) {
+            cell.position = run_positions[i];
+        }
+        if (op.code == OpCode::kClear) {
+            cell.clear = true;
+            cell.delta = 0;
+        } else {
+            cell.delta += static_cast<uint32_t>(op.arg);
+        }
+        cell.cost += op.cost;
+    }
+
+    size_t first = result->size();
+    auto push = [&](Op op, size_t position) {
+        result->push_back(op);
+        positions->push_back(position);
+    };
+    // Each cell ends up as (cleared ? 0 : old value) + delta, independently of
+    // the other cells, so all clears can go before all adds.
+    for (auto it = cells.begin(); it != cells.end();) {
+        if (!it->second.clear) {
+            ++it;
+            continue;
+        }
+        int start = it->first;
+        size_t position = it->second.position;
+        uint32_t cost = 0;
+        int count = 0;
+        for (; it != cells.end() && it->second.clear && it->first == start + count; ++it, ++count) {
+            cost += it->second.cost;
+        }
+        if (count == 1) {
+            push(Op{OpCode::kClear, 0, start, cost}, position);
+        } else {
+            push(Op{OpCode::kClearRange, count, start, cost}, position);
+        }
+    }
+    for (const auto& [offset, cell] : cells) {
+        if (cell.delta != 0) {
+            push(Op{OpCode::kAdd, static_cast<int32_t>(cell.delta), offset, cell.clear ? 0 : cell.cost}, cell.position);
+        } else if (!cell.clear) {
+            move_cost += cell.cost;
+        }
+    }
+    if (pos != 0) {
+        push(Op{OpCode::kMove, pos, 0, move_cost}, move_position);
+    } else if (result->size() > first) {
+        (*result)[first].cost += move_cost;
+    } else {
+        *carried_cost += move_cost;
+    }
+}
+
+// Rewrites the runs of adds, moves and plain clears in ops with
+// address_run_by_offset() and remaps the loop targets.
+void address_by_offset(std::vector<Op>* ops, std::vector<size_t>* positions) {
+    std::vector<Op> result;
+    std::vector<size_t> result_positions;
+    std::vector<size_t> loop_starts;
+    uint32_t carried_cost = 0;
+    size_t i = 0;
+    while (i < ops->size()) {
+        size_t end = i;
+        while (end < ops->size() && in_straight_run((*ops)[end])) {
+            end++;
+        }
+        if (end - i >= 2) {
+            address_run_by_offset(ops->data() + i, end - i, positions->data() + i, &result, &result_positions,
+                                  &carried_cost);
+            i = end;
+            continue;
+        }
+        Op op = (*ops)[i];
+        op.cost += carried_cost;
+        carried_cost = 0;
+        if (op.code == OpCode::kLoopStart) {
+            loop_starts.push_back(result.size());
+        } else if (op.code == OpCode::kLoopEnd) {
+            size_t start = loop_starts.back();
+            loop_starts.pop_back();
+            op.arg = start + 1;
+            result[start].arg = result.size() + 1;
+        }
+        result.push_back(op);
+        result_positions.push_back((*positions)[i]);
+        i++;
+    }
+    *ops = std::move(result);
+    *positions = std::move(result_positions);
+}
+
+// Turns the kLoopEnd at ops[end] into a kIfEnd if the straight-line ops
+// that end the loop body leave tp on a cell they have cleared.
+void lower_if_loop(std::vector<Op>* ops, size_t end) {
+    size_t start = (*ops)[end].arg - 1;
+    size_t run = end;
+    while (run > start + 1) {
+        OpCode code = (*ops)[run - 1].code;
+        if (code != OpCode::kAdd && code != OpCode::kMove && code != OpCode::kClear &&
+            code != OpCode::kClearRange && code != OpCode::kMulAdd) {
+            break;
+        }
+        run--;
+    }
+    std::set<int> zero;
+    int pos = 0;
+    for (size_t i = run; i < end; i++) {
+        const Op& op = (*ops)[i];
+        switch (op.code) {
+            case OpCode::kAdd:
+            case OpCode::kMulAdd:
+                zero.erase(pos + op.offset);
+                break;
+            case OpCode::kMove: pos += op.arg; break;
+            case OpCode::kClear: zero.insert(pos + op.offset); break;
+            case OpCode::kClearRange:
+                for (int j = 0; j < op.arg; j++) {
+                    zero.insert(pos + op.offset + j);
+                }
+                break;
+            default: break;
+        }
+    }
+    if (zero.count(pos) != 0) {
+        (*ops)[end].code = OpCode::kIfEnd;
+    }
+}
+
+bool ends_block(OpCode code) {
+    return code == OpCode::kLoopStart || code == OpCode::kLoopEnd || code == OpCode::kIfEnd || code == OpCode::kEnd;
+}
+
+// Charges the static cost of every basic block on the op that ends it. Blocks
+// have a single exit, so whenever that op runs the whole block has run.
+void assign_block_costs(std::vector<Op>* ops) {
+    uint32_t block_cost = 0;
+    for (Op& op : *ops) {
+        block_cost += op.cost;
+        op.cost = 0;
+        if (ends_block(op.code)) {
+            op.cost = block_cost;
+            block_cost = 0;
+        }
+    }
+}
+}  // namespace
+
+std::vector<Op> compile(const std::string& code, DebugInfo* debug_info) {
+    std::vector<Op> ops;
+    std::vector<size_t> positions;
+    std::vector<int> loop_starts;
+    size_t ip = 0;
+    size_t op_start = 0;
+    while (ip < code.size()) {
+        // Ops pushed by the previous iteration start where it started.
+        positions.resize(ops.size(), op_start);
+        op_start = ip;
+        if (code.compare(ip, 3, "[-]") == 0) {
+            ops.push_back(Op{OpCode::kClear});
+            ip += 3;
+            continue;
+        }
+        char t = code[ip++];
+        OpCode fold_code;
+        int delta;
+        if (is_foldable(t, &fold_code, &delta)) {
+            if (ops.empty() || ops.back().code != fold_code) {
+                ops.push_back(Op{fold_code, 0, 0, 0});
+            }
+            ops.back().arg += delta;
+            ops.back().cost++;
+            continue;
+        }
+        switch (t) {
+            case '.': ops.push_back(Op{OpCode::kOutput}); break;
+            case ',': ops.push_back(Op{OpCode::kInput}); break;
+            case '[':
+                loop_starts.push_back(ops.size());
+                ops.push_back(Op{OpCode::kLoopStart});
+                break;
+            case ']': {
+                if (loop_starts.empty()) {
+                    throw std::invalid_argument("unmatched loop end at pos " + std::to_string(ip));
+                }
+                int start = loop_starts.back();
+                loop_starts.pop_back();
+                if (lower_mul_loop(&ops, start) || lower_scan_loop(&ops, start)) {
+                    size_t loop_position = positions[start];
+                    positions.resize(start);
+                    positions.resize(ops.size(), loop_position);
+                    break;
+                }
+                int end = ops.size();
+                // The closing bracket also pays for the re-test of the
+                // opening one that the plain interpreter would jump back to.
+                ops.push_back(Op{OpCode::kLoopEnd, start + 1, 0, 2});
+                ops[start].arg = end + 1;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (!loop_starts.empty()) {
+        throw std::invalid_argument("unmatched loop start at op " + std::to_string(loop_starts.back()));
+    }
+    positions.resize(ops.size(), op_start);
+    ops.push_back(Op{OpCode::kEnd, 0, 0, 0});
+    positions.push_back(code.size());
+    address_by_offset(&ops, &positions);
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (ops[i].code == OpCode::kLoopEnd) {
+            lower_if_loop(&ops, i);
+        }
+    }
+    if (debug_info != nullptr) {
+        debug_info->positions = std::move(positions);
+        debug_info->costs.clear();
+        for (const Op& op : ops) {
+            debug_info->costs.push_back(op.cost);
+        }
+    }
+    assign_block_costs(&ops);
+    return ops;
+}
+
+const char* opcode_name(OpCode code) {
+    switch (code) {
+        case OpCode::kAdd: return "add";
+        case OpCode::kMove: return "move";
+        case OpCode::kClear: return "clear";
+        case OpCode::kClearRange: return "clear_range";
+        case OpCode::kMulAdd: return "mul_add";
+        case OpCode::kScan: return "scan";
+        case OpCode::kOutput: return "output";
+        case OpCode::kInput: return "input";
+        case OpCode::kLoopStart: return "loop_start";
+        case OpCode::kLoopEnd: return "loop_end";
+        case OpCode::kIfEnd: return "if_end";
+        case OpCode::kEnd: return "end";
+    }
+    return "unknown";
+}
+
+std::string Op::DebugString() const {
+    switch (code) {
+        case OpCode::kAdd: return "add [" + std::to_string(offset) + "] " + std::to_string(arg);
+        case OpCode::kMove: return "move " + std::to_string(arg);
+        case OpCode::kClear: return "clear [" + std::to_string(offset) + "]";
+        case OpCode::kClearRange: return "clear_range [" + std::to_string(offset) + "] " + std::to_string(arg);
+        case OpCode::kMulAdd: return "mul_add [" + std::to_string(offset) + "] " + std::to_string(arg);
+        case OpCode::kScan: return "scan " + std::to_string(arg);
+        case OpCode::kOutput: return "output";
+        case OpCode::kInput: return "input";
+        case OpCode::kLoopStart: return "loop_start -> " + std::to_string(arg);
+        case OpCode::kLoopEnd: return "loop_end -> " + std::to_string(arg);
+        case OpCode::kIfEnd: return "if_end";
+        case OpCode::kEnd: return "end";
+    }
+    return "unknown";
+}
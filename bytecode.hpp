@@ -0,0 +1,71 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class OpCode : uint8_t {
+    kAdd,        // tape[tp + offset] += arg
+    kMove,       // tp += arg
+    kClear,      // tape[tp + offset] = 0
+    kClearRange, // tape[tp + offset + i] = 0 for 0 <= i < arg
+    kMulAdd,     // tape[tp + offset] += tape[tp] * arg
+    kScan,       // while tape[tp] != 0: tp += arg
+    kOutput,     // putchar(tape[tp])
+    kInput,      // tape[tp] = getchar()
+    kLoopStart,  // if tape[tp] == 0: ip = arg
+    kLoopEnd,    // if tape[tp] != 0: ip = arg
+    kIfEnd,      // end of a loop whose body always leaves tape[tp] == 0
+    kEnd,        // last op of every program
+};
+
+// Number of OpCode values, for tables indexed by op code.
+const size_t kOpCodeCount = static_cast<size_t>(OpCode::kEnd) + 1;
+
+// "add", "mul_add", "loop_start" and so on.
+const char* opcode_name(OpCode code);
+
+struct Op {
+    OpCode code;
+    int32_t arg = 0;
+    int32_t offset = 0;
+    // Number of source instructions this op stands for, so that max_steps
+    // keeps counting the same steps as the unoptimized program. compile()
+    // moves the cost of every basic block onto the loop op or kEnd that
+    // closes it, so engines only charge and check the budget there.
+    uint32_t cost = 1;
+    // Steps charged per iteration of a loop that was collapsed into this op.
+    uint32_t iteration_cost = 0;
+
+    std::string DebugString() const;
+};
+
+// Changes whenever compile() or the layout of Op change, so that programs
+// cached by an older bfi are compiled again, see bytecode_cache.hpp.
+const uint32_t kBytecodeVersion = 1;
+
+// Per-op information for tools that map execution back to the source.
+struct DebugInfo {
+    // Index in the compiled code of the first instruction each op came from.
+    std::vector<size_t> positions;
+    // Cost of each op before block costs were moved to the end of blocks.
+    std::vector<uint32_t> costs;
+};
+
+// Lowers brainfuck source into ops. Runs of +/- and </> are folded into a
+// single op and loop ops hold the index of the op to continue at.
+// Balanced loops that only add and move and decrement the loop cell by one,
+// like [->+>+<<], become a kMulAdd per target cell followed by a kClear.
+// Loops that only move, like [>] or [<<<<], become a kScan.
+// Within runs of adds, moves and clears, adds and clears address their cell
+// by offset from the tape pointer at the start of the run, which then moves
+// once at the end of the run; clears of adjacent cells become a kClearRange.
+// Loops that provably run at most once, like bfs's "c[ ... c[-]]" for if,
+// end with a kIfEnd instead of a kLoopEnd, so they only branch forward.
+// Characters that are not brainfuck instructions are ignored. The result
+// always ends with a kEnd op.
+std::vector<Op> compile(const std::string& code, DebugInfo* debug_info = nullptr);
+
+#endif  // BYTECODE_HPP
@@ -0,0 +1,188 @@
+#include "bytecode_cache.hpp"
+#include "source.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// A cache file is the magic and then 64-bit integers in host byte order: the
+// version, the two hashes of the settings and the source, the source size, the
+// settings and the op count. Every op follows as its code, arg, offset, cost
+// and iteration_cost, each written as 32 bits, so the file does not depend on
+// how the compiler lays out Op and holds no padding.
+const char kMagic[8] = {'B', 'F', 'I', 'C', 'O', 'D', 'E', '2'};
+const size_t kHeaderSize = sizeof(kMagic) + 6 * sizeof(uint64_t);
+const size_t kOpSize = 5 * sizeof(uint32_t);
+
+// FNV-1a over the settings and the source; names the cache file.
+uint64_t cache_key(std::string_view source, bool strip_comments) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    hash = (hash ^ (strip_comments ? 1 : 0)) * 0x100000001B3ull;
+    for (char c : source) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// A second, unrelated hash of the same, so that a program whose key collides
+// with another's still misses.
+uint64_t cache_check(std::string_view source, bool strip_comments) {
+    uint64_t hash = strip_comments ? 1 : 0;
+    for (char c : source) {
+        hash = (hash + static_cast<unsigned char>(c) + 1) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+std::string cache_path(const std::string& directory, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bfc", static_cast<unsigned long long>(key));
+    return directory + "/" + name;
+}
+
+// Everything before the op count.
+void append_header(std::string_view source, bool strip_comments, std::string* out) {
+    out->append(kMagic, sizeof(kMagic));
+    uint64_t fields[] = {kBytecodeVersion, cache_key(source, strip_comments), cache_check(source, strip_comments),
+                         source.size(), strip_comments ? 1u : 0u};
+    out->append(reinterpret_cast<const char*>(fields), sizeof(fields));
+}
+
+void append_uint32(uint32_t value, std::string* out) {
+    out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+uint32_t read_uint32(const char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// The engines trust that loop ops pair up like compile() makes them, that
+// scans move and that kEnd comes last, so a damaged file, or one whose key
+// collides with another program's, must not get that far.
+bool is_runnable(const std::vector<Op>& code) {
+    if (code.empty() || code.back().code != OpCode::kEnd) {
+        return false;
+    }
+    std::vector<size_t> starts;
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        const Op& op = code[ip];
+        switch (op.code) {
+            case OpCode::kLoopStart: starts.push_back(ip); break;
+            case OpCode::kLoopEnd:
+            case OpCode::kIfEnd: {
+                if (starts.empty()) {
+                    return false;
+                }
+                size_t start = starts.back();
+                starts.pop_back();
+                if (static_cast<size_t>(code[start].arg) != ip + 1 || static_cast<size_t>(op.arg) != start + 1) {
+                    return false;
+                }
+                break;
+            }
+            case OpCode::kScan:
+                if (op.arg == 0) {
+                    return false;
+                }
+                break;
+            case OpCode::kClearRange:
+                if (op.arg < 1) {
+                    return false;
+                }
+                break;
+            case OpCode::kEnd:
+                if (ip + 1 != code.size()) {
+                    return false;
+                }
+                break;
+            case OpCode::kAdd:
+            case OpCode::kMove:
+            case OpCode::kClear:
+            case OpCode::kMulAdd:
+            case OpCode::kOutput:
+            case OpCode::kInput: break;
+            default: return false;
+        }
+    }
+    return starts.empty();
+}
+
+}  // namespace
+
+bool load_cached_bytecode(const std::string& directory, std::string_view source, bool strip_comments,
+                          std::vector<Op>* code) {
+    std::string expected;
+    append_header(source, strip_comments, &expected);
+    SourceFile file(cache_path(directory, cache_key(source, strip_comments)));
+    if (!file.is_open() || file.contents().size() < kHeaderSize) {
+        return false;
+    }
+    std::string_view contents = file.contents();
+    if (contents.substr(0, expected.size()) != expected) {
+        return false;
+    }
+    uint64_t op_count;
+    std::memcpy(&op_count, contents.data() + expected.size(), sizeof(op_count));
+    if ((contents.size() - kHeaderSize) / kOpSize != op_count || (contents.size() - kHeaderSize) % kOpSize != 0) {
+        return false;
+    }
+    code->resize(op_count);
+    const char* data = contents.data() + kHeaderSize;
+    for (Op& op : *code) {
+        uint32_t op_code = read_uint32(data);
+        if (op_code >= kOpCodeCount) {
+            return false;
+        }
+        op.code = static_cast<OpCode>(op_code);
+        op.arg = static_cast<int32_t>(read_uint32(data + 4));
+        op.offset = static_cast<int32_t>(read_uint32(data + 8));
+        op.cost = read_uint32(data + 12);
+        op.iteration_cost = read_uint32(data + 16);
+        data += kOpSize;
+    }
+    return is_runnable(*code);
+}
+
+void save_cached_bytecode(const std::string& directory, std::string_view source, bool strip_comments,
+                          const std::vector<Op>& code) {
+    if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+        throw std::runtime_error("could not create bytecode cache " + directory);
+    }
+    std::string contents;
+    contents.reserve(kHeaderSize + code.size() * kOpSize);
+    append_header(source, strip_comments, &contents);
+    uint64_t op_count = code.size();
+    contents.append(reinterpret_cast<const char*>(&op_count), sizeof(op_count));
+    for (const Op& op : code) {
+        append_uint32(static_cast<uint32_t>(op.code), &contents);
+        append_uint32(static_cast<uint32_t>(op.arg), &contents);
+        append_uint32(static_cast<uint32_t>(op.offset), &contents);
+        append_uint32(op.cost, &contents);
+        append_uint32(op.iteration_cost, &contents);
+    }
+    std::string path = cache_path(directory, cache_key(source, strip_comments));
+    // Per process, since several runs may cache the same program at once.
+    std::string temp_path = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        out.write(contents.data(), contents.size());
+        out.close();
+        if (!out) {
+            std::remove(temp_path.c_str());
+            throw std::runtime_error("could not write bytecode cache " + path);
+        }
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("could not replace bytecode cache " + path);
+    }
+}
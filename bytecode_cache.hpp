@@ -0,0 +1,26 @@
+#ifndef BYTECODE_CACHE_HPP
+#define BYTECODE_CACHE_HPP
+
+#include "bytecode.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compiled programs kept in a directory, so that running the same program
+// again skips filtering and compiling it. A cached program is looked up by a
+// hash of the raw source and of the settings that change what it compiles
+// to, and is only used if it was written by the same kBytecodeVersion and a
+// second hash and the size of the source match as well.
+
+// Stores in *code the ops cached in directory for source filtered with
+// strip_comments, see filter_source(). Returns false if there are none or
+// the cached file is unusable.
+bool load_cached_bytecode(const std::string& directory, std::string_view source, bool strip_comments,
+                          std::vector<Op>* code);
+// Caches code as the compiled form of source. The file is written next to
+// its final name first and renamed, so concurrent runs never see half of
+// it. Throws std::runtime_error.
+void save_cached_bytecode(const std::string& directory, std::string_view source, bool strip_comments,
+                          const std::vector<Op>& code);
+
+#endif  // BYTECODE_CACHE_HPP
@@ -0,0 +1,146 @@
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+// The file is the magic, the cell size in bytes, the fields of Checkpoint and
+// the page count as 64-bit integers, and then every page as its first cell
+// index followed by its kPageSize cells, all in host byte order.
+const char kMagic[8] = {'B', 'F', 'I', 'C', 'K', 'P', 'T', '1'};
+
+uint64_t fnv1a(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        hash ^= (value >> (i * 8)) & 0xFF;
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+class File {
+public:
+    File(const std::string& path, const char* mode) : path_(path), file_(std::fopen(path.c_str(), mode)) {
+        if (file_ == nullptr) {
+            throw std::runtime_error("could not open checkpoint " + path);
+        }
+    }
+    ~File() {
+        if (file_ != nullptr) {
+            std::fclose(file_);
+        }
+    }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    void write(const void* data, size_t size) {
+        if (std::fwrite(data, 1, size, file_) != size) {
+            throw std::runtime_error("could not write checkpoint " + path_);
+        }
+    }
+    void write_int(int64_t value) { write(&value, sizeof(value)); }
+    void read(void* data, size_t size) {
+        if (std::fread(data, 1, size, file_) != size) {
+            throw std::runtime_error("truncated checkpoint " + path_);
+        }
+    }
+    int64_t read_int() {
+        int64_t value;
+        read(&value, sizeof(value));
+        return value;
+    }
+    void close() {
+        FILE* file = file_;
+        file_ = nullptr;
+        if (std::fclose(file) != 0) {
+            throw std::runtime_error("could not write checkpoint " + path_);
+        }
+    }
+
+private:
+    std::string path_;
+    FILE* file_;
+};
+
+}  // namespace
+
+uint64_t hash_program(const std::vector<Op>& code) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (const Op& op : code) {
+        hash = fnv1a(hash, static_cast<uint64_t>(op.code) | static_cast<uint64_t>(static_cast<uint32_t>(op.arg)) << 8);
+        hash = fnv1a(hash, static_cast<uint32_t>(op.offset) | static_cast<uint64_t>(op.cost) << 32);
+        hash = fnv1a(hash, op.iteration_cost);
+    }
+    return hash;
+}
+
+template <typename Cell>
+void save_checkpoint(const std::string& path, const Checkpoint& checkpoint, BasicTape<Cell>& tape) {
+    const Cell* cells = tape.zero_cell();
+    std::vector<int> pages;
+    for (int page = tape.begin_index(); page < tape.end_index(); page += Tape::kPageSize) {
+        const Cell* begin = cells + page;
+        if (std::any_of(begin, begin + Tape::kPageSize, [](Cell cell) { return cell != 0; })) {
+            pages.push_back(page);
+        }
+    }
+
+    std::string temp_path = path + ".tmp";
+    File file(temp_path, "wb");
+    file.write(kMagic, sizeof(kMagic));
+    file.write_int(sizeof(Cell));
+    file.write_int(checkpoint.program_hash);
+    file.write_int(checkpoint.ip);
+    file.write_int(checkpoint.tp);
+    file.write_int(checkpoint.steps);
+    file.write_int(checkpoint.input_offset);
+    file.write_int(pages.size());
+    for (int page : pages) {
+        file.write_int(page);
+        file.write(cells + page, Tape::kPageSize * sizeof(Cell));
+    }
+    file.close();
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("could not replace checkpoint " + path);
+    }
+}
+
+template <typename Cell>
+Checkpoint load_checkpoint(const std::string& path, BasicTape<Cell>* tape) {
+    File file(path, "rb");
+    char magic[sizeof(kMagic)];
+    file.read(magic, sizeof(magic));
+    if (!std::equal(magic, magic + sizeof(magic), kMagic)) {
+        throw std::runtime_error(path + " is not a bfi checkpoint");
+    }
+    int64_t cell_size = file.read_int();
+    if (cell_size != sizeof(Cell)) {
+        throw std::runtime_error("checkpoint " + path + " was saved with " + std::to_string(cell_size * 8) + "-bit cells");
+    }
+    Checkpoint checkpoint;
+    checkpoint.program_hash = file.read_int();
+    checkpoint.ip = file.read_int();
+    checkpoint.tp = file.read_int();
+    checkpoint.steps = file.read_int();
+    checkpoint.input_offset = file.read_int();
+    int64_t page_count = file.read_int();
+    for (int64_t i = 0; i < page_count; ++i) {
+        int64_t page = file.read_int();
+        if (page % Tape::kPageSize != 0) {
+            throw std::runtime_error("corrupt checkpoint " + path);
+        }
+        tape->ensure(page);
+        tape->ensure(page + Tape::kPageSize - 1);
+        file.read(tape->zero_cell() + page, Tape::kPageSize * sizeof(Cell));
+    }
+    return checkpoint;
+}
+
+template void save_checkpoint(const std::string&, const Checkpoint&, BasicTape<uint8_t>&);
+template void save_checkpoint(const std::string&, const Checkpoint&, BasicTape<uint16_t>&);
+template void save_checkpoint(const std::string&, const Checkpoint&, BasicTape<uint32_t>&);
+template void save_checkpoint(const std::string&, const Checkpoint&, BasicTape<uint64_t>&);
+template Checkpoint load_checkpoint(const std::string&, BasicTape<uint8_t>*);
+template Checkpoint load_checkpoint(const std::string&, BasicTape<uint16_t>*);
+template Checkpoint load_checkpoint(const std::string&, BasicTape<uint32_t>*);
+template Checkpoint load_checkpoint(const std::string&, BasicTape<uint64_t>*);
@@ -0,0 +1,36 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "bytecode.hpp"
+#include "tape.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Interpreter state between two ops, enough to continue a run later. The tape
+// itself is saved next to it by save_checkpoint().
+struct Checkpoint {
+    uint64_t program_hash = 0;  // see hash_program()
+    size_t ip = 0;
+    int tp = 0;
+    size_t steps = 0;
+    size_t input_offset = 0;  // bytes ',' has consumed from stdin
+};
+
+// Identifies the compiled program a checkpoint belongs to, so that one is not
+// resumed with a different program or a different bfi.
+uint64_t hash_program(const std::vector<Op>& code);
+
+// Writes checkpoint and every page of tape that holds a nonzero cell to path.
+// The file is written next to path first and renamed over it, so an
+// interrupted save keeps the previous checkpoint. Throws std::runtime_error.
+template <typename Cell>
+void save_checkpoint(const std::string& path, const Checkpoint& checkpoint, BasicTape<Cell>& tape);
+// Reads a checkpoint written by save_checkpoint() and restores its pages into
+// tape, which should be empty and have the same cell width. Throws
+// std::runtime_error.
+template <typename Cell>
+Checkpoint load_checkpoint(const std::string& path, BasicTape<Cell>* tape);
+
+#endif  // CHECKPOINT_HPP
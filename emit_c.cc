@@ -0,0 +1,166 @@
+#include "emit_c.hpp"
+#include <stdexcept>
+
+namespace {
+
+const char kPrelude[] = R"(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint32_t Word;
+enum { kPageSize = 4096 };
+
+static Word* tape;  /* cell 0, valid for indices in [tape_begin, tape_end) */
+static Word* tape_cells;
+static long tape_begin = 0;
+static long tape_end = 0;
+
+static long page_floor(long index) {
+    long page = index / kPageSize;
+    if (index % kPageSize < 0) {
+        page--;
+    }
+    return page * kPageSize;
+}
+
+/* Grows the tape to cover index, at least doubling it to amortize copies. */
+static void grow(long index) {
+    long size = tape_end - tape_begin;
+    long begin = tape_begin;
+    long end = tape_end;
+    if (index < begin) {
+        begin = page_floor(index) < begin - size ? page_floor(index) : begin - size;
+    } else {
+        end = page_floor(index) + kPageSize > end + size ? page_floor(index) + kPageSize : end + size;
+    }
+    Word* cells = calloc((size_t)(end - begin), sizeof(Word));
+    if (cells == NULL) {
+        fputs("Error: Out of memory\n", stderr);
+        exit(1);
+    }
+    if (size > 0) {
+        memcpy(cells + (tape_begin - begin), tape_cells, (size_t)size * sizeof(Word));
+    }
+    free(tape_cells);
+    tape_cells = cells;
+    tape_begin = begin;
+    tape_end = end;
+    tape = cells - begin;
+}
+
+#define ENSURE(index) if ((index) < tape_begin || (index) >= tape_end) grow(index)
+)";
+
+const char kInputStart[] = R"(
+static Word input(Word current) {
+    fflush(stdout);
+    int ch = getchar();
+    if (ch == EOF) {
+)";
+
+const char kInputEnd[] = R"(    }
+    return (Word)ch;
+}
+)";
+
+// The body of the EOF branch of input() for eof.
+const char* eof_branch(EofBehavior eof) {
+    switch (eof) {
+        case EofBehavior::kError:
+            return "        fputs(\"Error: No input available from stdin\\n\", stderr);\n"
+                   "        exit(1);\n";
+        case EofBehavior::kZero: return "        return 0;\n";
+        case EofBehavior::kUnchanged: return "        return current;\n";
+    }
+    return "";
+}
+
+const char kMain[] = R"(
+int main(void) {
+    long tp = 0;
+    grow(0);
+)";
+
+std::string word(int32_t value) {
+    return std::to_string(static_cast<uint32_t>(value)) + "u";
+}
+
+std::string cell(int32_t offset) {
+    if (offset == 0) {
+        return "tape[tp]";
+    }
+    return "tape[tp + " + std::to_string(offset) + "]";
+}
+
+}  // namespace
+
+void emit_c(const std::vector<Op>& code, const std::string& source_name, EofBehavior eof, std::ostream& out) {
+    out << "/* Generated by bfi --emit-c from " << source_name << ". */\n";
+    out << kPrelude;
+    for (const Op& op : code) {
+        if (op.code == OpCode::kInput) {
+            out << kInputStart << eof_branch(eof) << kInputEnd;
+            break;
+        }
+    }
+    out << kMain;
+    int depth = 1;
+    auto line = [&out, &depth]() -> std::ostream& {
+        return out << std::string(4 * depth, ' ');
+    };
+    auto ensure = [&line](int32_t offset) {
+        if (offset != 0) {
+            line() << "ENSURE(tp + " << offset << ");\n";
+        }
+    };
+    for (const Op& op : code) {
+        switch (op.code) {
+            case OpCode::kAdd:
+                ensure(op.offset);
+                line() << cell(op.offset) << " += " << word(op.arg) << ";\n";
+                break;
+            case OpCode::kMove:
+                line() << "tp += " << op.arg << ";\n";
+                line() << "ENSURE(tp);\n";
+                break;
+            case OpCode::kClear:
+                ensure(op.offset);
+                line() << cell(op.offset) << " = 0;\n";
+                break;
+            case OpCode::kClearRange:
+                ensure(op.offset);
+                ensure(op.offset + op.arg - 1);
+                line() << "memset(&" << cell(op.offset) << ", 0, " << op.arg << " * sizeof(Word));\n";
+                break;
+            case OpCode::kMulAdd:
+                ensure(op.offset);
+                line() << cell(op.offset) << " += " << cell(0) << " * " << word(op.arg) << ";\n";
+                break;
+            case OpCode::kScan:
+                line() << "while (" << cell(0) << ") {\n";
+                line() << "    tp += " << op.arg << ";\n";
+                line() << "    ENSURE(tp);\n";
+                line() << "}\n";
+                break;
+            case OpCode::kOutput: line() << "putchar((char)" << cell(0) << ");\n"; break;
+            case OpCode::kInput: line() << cell(0) << " = input(" << cell(0) << ");\n"; break;
+            case OpCode::kLoopStart:
+                line() << (code[op.arg - 1].code == OpCode::kIfEnd ? "if (" : "while (") << cell(0) << ") {\n";
+                depth++;
+                break;
+            case OpCode::kLoopEnd:
+            case OpCode::kIfEnd:
+                if (depth <= 1) {
+                    throw std::invalid_argument("unbalanced loop end in bytecode");
+                }
+                depth--;
+                line() << "}\n";
+                break;
+            case OpCode::kEnd:
+                break;
+        }
+    }
+    out << "    return 0;\n";
+    out << "}\n";
+}
@@ -0,0 +1,15 @@
+#ifndef EMIT_C_HPP
+#define EMIT_C_HPP
+
+#include "bytecode.hpp"
+#include "io.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Writes a standalone C program that behaves like running code in bfi:
+// 32-bit cells, a tape that grows on demand in both directions and eof for
+// what ',' does at end of input. There is no step budget.
+void emit_c(const std::vector<Op>& code, const std::string& source_name, EofBehavior eof, std::ostream& out);
+
+#endif  // EMIT_C_HPP
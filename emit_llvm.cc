@@ -0,0 +1,217 @@
+#include "emit_llvm.hpp"
+#include <stdexcept>
+
+namespace {
+
+const char kRuntime[] = R"(
+@input_error = private constant [37 x i8] c"Error: No input available from stdin\0A"
+@tape_error = private constant [31 x i8] c"Error: Tape index out of range\0A"
+
+declare i32 @putchar(i32)
+declare i32 @getchar()
+declare i32 @fflush(ptr)
+declare i64 @write(i32, ptr, i64)
+declare void @exit(i32) noreturn
+declare void @llvm.memset.p0.i64(ptr, i8, i64, i1)
+
+define internal void @tape_overflow() cold noreturn {
+entry:
+  %written = call i64 @write(i32 2, ptr @tape_error, i64 31)
+  call void @exit(i32 1)
+  unreachable
+}
+)";
+
+const char kInputStart[] = R"(
+define internal i32 @input(i32 %current) {
+entry:
+  %flushed = call i32 @fflush(ptr null)
+  %ch = call i32 @getchar()
+  %eof = icmp eq i32 %ch, -1
+  br i1 %eof, label %end_of_input, label %done
+end_of_input:
+)";
+
+const char kInputEnd[] = R"(done:
+  ret i32 %ch
+}
+)";
+
+// The end_of_input block of @input for eof.
+const char* eof_block(EofBehavior eof) {
+    switch (eof) {
+        case EofBehavior::kError:
+            return "  %written = call i64 @write(i32 2, ptr @input_error, i64 37)\n"
+                   "  call void @exit(i32 1)\n"
+                   "  unreachable\n";
+        case EofBehavior::kZero: return "  ret i32 0\n";
+        case EofBehavior::kUnchanged: return "  ret i32 %current\n";
+    }
+    return "";
+}
+
+class LlvmEmitter {
+public:
+    explicit LlvmEmitter(std::ostream& out) : out_(out) {}
+
+    void emit(const std::vector<Op>& code, const std::string& source_name, EofBehavior eof) {
+        out_ << "; Generated by bfi --emit-llvm from " << source_name << ".\n";
+        out_ << "@tape = internal global [" << kLlvmTapeCells << " x i32] zeroinitializer\n";
+        out_ << kRuntime << kInputStart << eof_block(eof) << kInputEnd << "\n";
+        out_ << "define i32 @main() {\n";
+        out_ << "entry:\n";
+        out_ << "  %tp = alloca i64\n";
+        out_ << "  store i64 " << kLlvmTapeOrigin << ", ptr %tp\n";
+        std::vector<int> loops;
+        for (const Op& op : code) {
+            switch (op.code) {
+                case OpCode::kAdd: {
+                    std::string p = cell(op.offset);
+                    std::string v = load(p);
+                    store(p, binary("add", v, std::to_string(op.arg)));
+                    break;
+                }
+                case OpCode::kMove: move(op.arg); break;
+                case OpCode::kClear: store(cell(op.offset), "0"); break;
+                case OpCode::kClearRange: {
+                    std::string p = cell(op.offset);
+                    check(index(op.offset + op.arg - 1));
+                    out_ << "  call void @llvm.memset.p0.i64(ptr " << p << ", i8 0, i64 " << 4L * op.arg << ", i1 false)\n";
+                    break;
+                }
+                case OpCode::kMulAdd: {
+                    std::string v = load(cell(0));
+                    std::string p = cell(op.offset);
+                    std::string product = binary("mul", v, std::to_string(op.arg));
+                    store(p, binary("add", load(p), product));
+                    break;
+                }
+                case OpCode::kScan: {
+                    int id = next_label_++;
+                    loop_header(id);
+                    move(op.arg);
+                    loop_footer(id, true);
+                    break;
+                }
+                case OpCode::kOutput: {
+                    std::string v = binary("and", load(cell(0)), "255");
+                    out_ << "  " << tmp() << " = call i32 @putchar(i32 " << v << ")\n";
+                    break;
+                }
+                case OpCode::kInput: {
+                    std::string p = cell(0);
+                    std::string current = load(p);
+                    std::string ch = tmp();
+                    out_ << "  " << ch << " = call i32 @input(i32 " << current << ")\n";
+                    store(p, ch);
+                    break;
+                }
+                case OpCode::kLoopStart:
+                    loops.push_back(next_label_++);
+                    loop_header(loops.back());
+                    break;
+                case OpCode::kLoopEnd:
+                case OpCode::kIfEnd:
+                    if (loops.empty()) {
+                        throw std::invalid_argument("unbalanced loop end in bytecode");
+                    }
+                    loop_footer(loops.back(), op.code == OpCode::kLoopEnd);
+                    loops.pop_back();
+                    break;
+                case OpCode::kEnd:
+                    break;
+            }
+        }
+        out_ << "  ret i32 0\n";
+        out_ << "overflow:\n";
+        out_ << "  call void @tape_overflow()\n";
+        out_ << "  unreachable\n";
+        out_ << "}\n";
+    }
+
+private:
+    std::string tmp() {
+        return "%t" + std::to_string(next_tmp_++);
+    }
+
+    std::string binary(const std::string& op, const std::string& lhs, const std::string& rhs) {
+        std::string result = tmp();
+        out_ << "  " << result << " = " << op << " i32 " << lhs << ", " << rhs << "\n";
+        return result;
+    }
+
+    std::string load(const std::string& pointer) {
+        std::string result = tmp();
+        out_ << "  " << result << " = load i32, ptr " << pointer << "\n";
+        return result;
+    }
+
+    void store(const std::string& pointer, const std::string& value) {
+        out_ << "  store i32 " << value << ", ptr " << pointer << "\n";
+    }
+
+    std::string index(int32_t offset) {
+        std::string tp = tmp();
+        out_ << "  " << tp << " = load i64, ptr %tp\n";
+        if (offset == 0) {
+            return tp;
+        }
+        std::string result = tmp();
+        out_ << "  " << result << " = add i64 " << tp << ", " << offset << "\n";
+        return result;
+    }
+
+    std::string cell(int32_t offset) {
+        std::string i = index(offset);
+        if (offset != 0) {
+            check(i);
+        }
+        std::string result = tmp();
+        out_ << "  " << result << " = getelementptr inbounds [" << kLlvmTapeCells << " x i32], ptr @tape, i64 0, i64 " << i << "\n";
+        return result;
+    }
+
+    // Branches to the overflow block unless index lies within the array.
+    void check(const std::string& index) {
+        std::string inside = tmp();
+        std::string label = "in_range" + std::to_string(next_label_++);
+        out_ << "  " << inside << " = icmp ult i64 " << index << ", " << kLlvmTapeCells << "\n";
+        out_ << "  br i1 " << inside << ", label %" << label << ", label %overflow, !prof !0\n";
+        out_ << label << ":\n";
+    }
+
+    void move(int32_t distance) {
+        std::string i = index(distance);
+        out_ << "  store i64 " << i << ", ptr %tp\n";
+        check(i);
+    }
+
+    void loop_header(int id) {
+        std::string n = std::to_string(id);
+        out_ << "  br label %loop" << n << "\n";
+        out_ << "loop" << n << ":\n";
+        std::string value = load(cell(0));
+        std::string nonzero = tmp();
+        out_ << "  " << nonzero << " = icmp ne i32 " << value << ", 0\n";
+        out_ << "  br i1 " << nonzero << ", label %body" << n << ", label %exit" << n << "\n";
+        out_ << "body" << n << ":\n";
+    }
+
+    // Loops that end with a kIfEnd run at most once and skip the back-edge.
+    void loop_footer(int id, bool back_edge) {
+        std::string n = std::to_string(id);
+        out_ << "  br label %" << (back_edge ? "loop" : "exit") << n << "\n";
+        out_ << "exit" << n << ":\n";
+    }
+
+    std::ostream& out_;
+    int next_tmp_ = 0;
+    int next_label_ = 0;
+};
+
+}  // namespace
+
+void emit_llvm(const std::vector<Op>& code, const std::string& source_name, EofBehavior eof, std::ostream& out) {
+    LlvmEmitter(out).emit(code, source_name, eof);
+    out << "\n!0 = !{!\"branch_weights\", i32 2000, i32 1}\n";
+}
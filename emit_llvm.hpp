@@ -0,0 +1,20 @@
+#ifndef EMIT_LLVM_HPP
+#define EMIT_LLVM_HPP
+
+#include "bytecode.hpp"
+#include "io.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Writes the program as textual LLVM IR (opaque pointers) for clang or llc.
+// Loops become basic blocks and the tape is a fixed-size global i32 array
+// whose cell 0 sits at kLlvmTapeOrigin, so negative indices work too.
+// Moving off either end of the array exits with an error, and ',' does what
+// eof says at end of input. There is no step budget.
+constexpr long kLlvmTapeCells = 1L << 24;
+constexpr long kLlvmTapeOrigin = 1L << 20;
+
+void emit_llvm(const std::vector<Op>& code, const std::string& source_name, EofBehavior eof, std::ostream& out);
+
+#endif  // EMIT_LLVM_HPP
@@ -0,0 +1,57 @@
+#include "instance.hpp"
+#include <stdexcept>
+
+// The interpreter for the cell width chosen at run time.
+class Instance::Runner {
+public:
+    virtual ~Runner() = default;
+    virtual bool run_for(size_t steps, size_t max_steps, Engine engine) = 0;
+    virtual size_t steps() const = 0;
+};
+
+template <typename Cell>
+class Instance::CellRunner : public Instance::Runner {
+public:
+    CellRunner(const std::string& code, BufferedIo* io) : interpreter_(code, io) {}
+    bool run_for(size_t steps, size_t max_steps, Engine engine) override {
+        return interpreter_.run_for(steps, max_steps, engine);
+    }
+    size_t steps() const override { return interpreter_.steps(); }
+
+private:
+    BrainfuckInterpreter<Cell> interpreter_;
+};
+
+Instance::Instance(const std::string& code, const InstanceOptions& options, BufferedIo::ReadFunction read,
+                   BufferedIo::WriteFunction write)
+    : options_(options), io_(std::move(read), std::move(write), options.eof, false, options.buffer_size) {
+    switch (options.cell_bits) {
+        case 8: runner_ = std::make_unique<CellRunner<uint8_t>>(code, &io_); break;
+        case 16: runner_ = std::make_unique<CellRunner<uint16_t>>(code, &io_); break;
+        case 32: runner_ = std::make_unique<CellRunner<uint32_t>>(code, &io_); break;
+        case 64: runner_ = std::make_unique<CellRunner<uint64_t>>(code, &io_); break;
+        default: throw std::invalid_argument("unsupported cell width " + std::to_string(options.cell_bits));
+    }
+}
+
+Instance::~Instance() = default;
+
+Instance::State Instance::run_for(size_t steps) {
+    if (state_ != State::kRunning) {
+        return state_;
+    }
+    try {
+        if (runner_->run_for(steps, options_.max_steps, options_.engine)) {
+            state_ = State::kFinished;
+        }
+    } catch (const std::runtime_error& e) {
+        state_ = State::kFailed;
+        error_ = e.what();
+    }
+    io_.flush();
+    return state_;
+}
+
+size_t Instance::steps() const {
+    return runner_->steps();
+}
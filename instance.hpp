@@ -0,0 +1,58 @@
+#ifndef INSTANCE_HPP
+#define INSTANCE_HPP
+
+#include "interpreter.hpp"
+#include "io.hpp"
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <string>
+
+// Settings for an Instance.
+struct InstanceOptions {
+    int cell_bits = 32;  // 8, 16, 32 or 64
+    // kJit and kTiered run threaded, see BrainfuckInterpreter::run_for().
+    Engine engine = Engine::kThreaded;
+    size_t max_steps = std::numeric_limits<size_t>::max();
+    EofBehavior eof = EofBehavior::kError;
+    // Bytes of input and of output buffered between calls of the callbacks.
+    size_t buffer_size = 4096;
+};
+
+// One run of a brainfuck program inside the calling process, so that running
+// many small programs costs neither a process nor pipes each. It runs in
+// slices with run_for(), which lets a caller interleave many of them, see
+// Scheduler; input and output go through callbacks.
+class Instance {
+public:
+    enum class State { kRunning, kFinished, kFailed };
+
+    // Throws std::invalid_argument for unbalanced code or unsupported
+    // cell_bits.
+    Instance(const std::string& code, const InstanceOptions& options, BufferedIo::ReadFunction read,
+             BufferedIo::WriteFunction write);
+    ~Instance();
+    Instance(const Instance&) = delete;
+    Instance& operator=(const Instance&) = delete;
+
+    // Runs about steps more steps, see BrainfuckInterpreter::run_for(), and
+    // hands the output to the write callback. Returns state().
+    State run_for(size_t steps);
+    State state() const { return state_; }
+    // Why the run failed, e.g. "Maximum steps (1000) reached".
+    const std::string& error() const { return error_; }
+    size_t steps() const;
+
+private:
+    class Runner;
+    template <typename Cell>
+    class CellRunner;
+
+    InstanceOptions options_;
+    BufferedIo io_;
+    std::unique_ptr<Runner> runner_;
+    State state_ = State::kRunning;
+    std::string error_;
+};
+
+#endif  // INSTANCE_HPP
@@ -0,0 +1,576 @@
+#include "interpreter.hpp"
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+
+const uint32_t kHotLoopBackEdges = 1000;
+const size_t kDetectFirstSlice = 1 << 12;
+const size_t kDetectWatchFraction = 8;
+
+// Multiplies like the cell type wraps, without the int promotion of 8- and
+// 16-bit cells overflowing.
+template <typename Cell>
+Cell multiply(Cell value, int32_t factor) {
+    return static_cast<Cell>(static_cast<uint64_t>(value) * static_cast<uint64_t>(static_cast<int64_t>(factor)));
+}
+
+const std::atomic<int> no_checkpoint_request{0};
+
+}  // namespace
+
+// Lock-free, so the signal handler may set it.
+static_assert(std::atomic<int>::is_always_lock_free);
+std::atomic<int> checkpoint_requested{0};
+
+template <typename Cell>
+BrainfuckInterpreter<Cell>::BrainfuckInterpreter(std::string code, BufferedIo* io)
+    : io_(io), code_(compile(code)), block_counts_(code_.size()), checkpoint_request_(&no_checkpoint_request) {}
+
+template <typename Cell>
+BrainfuckInterpreter<Cell>::BrainfuckInterpreter(std::vector<Op> code, BufferedIo* io)
+    : io_(io), code_(std::move(code)), block_counts_(code_.size()), checkpoint_request_(&no_checkpoint_request) {}
+
+template <typename Cell>
+bool BrainfuckInterpreter<Cell>::run_step() {
+    if (ip_ >= code_.size()) {
+        return false;
+    }
+    const Op& op = code_[ip_++];
+    switch (op.code) {
+        case OpCode::kOutput: output(); break;
+        case OpCode::kInput: input(); break;
+        case OpCode::kAdd: tape_[tp_ + op.offset] += op.arg; break;
+        case OpCode::kClear: {
+            Cell& cell = tape_[tp_ + op.offset];
+            steps_ += static_cast<size_t>(op.iteration_cost) * cell;
+            cell = 0;
+            break;
+        }
+        case OpCode::kClearRange: tape_.clear(tp_ + op.offset, op.arg); break;
+        case OpCode::kMulAdd: {
+            Cell value = tape_[tp_];
+            tape_[tp_ + op.offset] += multiply(value, op.arg);
+            break;
+        }
+        case OpCode::kMove: tp_ += op.arg; break;
+        case OpCode::kScan: {
+            int end = tape_.find_zero(tp_, op.arg);
+            steps_ += static_cast<size_t>((end - tp_) / op.arg) * op.iteration_cost;
+            tp_ = end;
+            break;
+        }
+        case OpCode::kLoopStart:
+            if (!charge_block(op.cost)) {
+                return false;
+            }
+            if (tape_[tp_] == 0) {
+                ip_ = op.arg;
+            }
+            break;
+        case OpCode::kLoopEnd:
+            if (!charge_block(op.cost)) {
+                return false;
+            }
+            if (tape_[tp_] != 0) {
+                ip_ = op.arg;
+            }
+            break;
+        case OpCode::kIfEnd:
+        case OpCode::kEnd: return charge_block(op.cost);
+    }
+    return true;
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::output() {
+    io_->write(static_cast<char>(tape_[tp_]));
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::input() {
+    int c = io_->read();
+    if (c >= 0) {
+        tape_[tp_] = static_cast<Cell>(c);
+    }
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::jit_output(void* self, Word value) {
+    static_cast<BrainfuckInterpreter*>(self)->io_->write(static_cast<char>(value));
+}
+
+template <typename Cell>
+Word BrainfuckInterpreter<Cell>::jit_input(void* self, Word current, bool* failed) {
+    BrainfuckInterpreter* interpreter = static_cast<BrainfuckInterpreter*>(self);
+    int c;
+    try {
+        c = interpreter->io_->read();
+    } catch (const std::runtime_error& e) {
+        interpreter->jit_input_error_ = e.what();
+        *failed = true;
+        return current;
+    }
+    return c < 0 ? current : static_cast<Word>(c);
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::fail_max_steps(size_t max_steps) {
+    throw std::runtime_error("Maximum steps (" + std::to_string(max_steps) + ") reached");
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::set_max_steps(size_t max_steps) {
+    max_steps_ = max_steps;
+    stop_at_ = std::min({max_steps_, next_checkpoint_, slice_end_});
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::enable_checkpoints(std::string path, size_t every) {
+    checkpoint_path_ = std::move(path);
+    checkpoint_request_ = &checkpoint_requested;
+    checkpoint_every_ = every;
+    if (every != 0) {
+        next_checkpoint_ = steps_ + every;
+    }
+    set_max_steps(max_steps_);
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::resume(const std::string& path) {
+    Checkpoint checkpoint = load_checkpoint(path, &tape_);
+    if (checkpoint.program_hash != hash_program(code_) || checkpoint.ip >= code_.size()) {
+        throw std::runtime_error("checkpoint " + path + " was saved for a different program");
+    }
+    if (!io_->skip_input(checkpoint.input_offset)) {
+        throw std::runtime_error("input ends before the offset saved in checkpoint " + path);
+    }
+    ip_ = checkpoint.ip;
+    tp_ = checkpoint.tp;
+    steps_ = checkpoint.steps;
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::restore(size_t ip, int tp, size_t steps) {
+    ip_ = ip;
+    tp_ = tp;
+    steps_ = steps;
+}
+
+template <typename Cell>
+bool BrainfuckInterpreter<Cell>::block_limit(size_t cost) {
+    if (steps_ >= max_steps_) {
+        fail_max_steps(max_steps_);
+    }
+    if (!checkpoint_path_.empty() && (*checkpoint_request_ || steps_ >= next_checkpoint_)) {
+        save_block_checkpoint(cost);
+    }
+    // The first block of a slice always runs, so every slice makes progress.
+    if (steps_ >= slice_end_ && steps_ - cost > slice_start_) {
+        // Like a checkpoint, stop right before the op; the next slice runs it
+        // again.
+        ip_--;
+        steps_ -= cost;
+        block_counts_[ip_]--;
+        return false;
+    }
+    return true;
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::save_block_checkpoint(size_t cost) {
+    // Only loop ops and kEnd charge steps, and they have not changed the
+    // tape yet, so the state is the one right before the op and resuming
+    // runs it again.
+    Checkpoint checkpoint;
+    checkpoint.program_hash = hash_program(code_);
+    checkpoint.ip = ip_ - 1;
+    checkpoint.tp = tp_;
+    checkpoint.steps = steps_ - cost;
+    checkpoint.input_offset = io_->input_offset();
+    // The output up to here belongs to the checkpoint.
+    io_->flush();
+    try {
+        save_checkpoint(checkpoint_path_, checkpoint, tape_);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+    checkpoint_requested = 0;
+    if (checkpoint_every_ != 0) {
+        while (next_checkpoint_ <= steps_) {
+            next_checkpoint_ += checkpoint_every_;
+        }
+    }
+    set_max_steps(max_steps_);
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run(size_t max_steps) {
+    set_max_steps(max_steps);
+    while(run_step()) {
+    }
+}
+
+template <typename Cell>
+bool BrainfuckInterpreter<Cell>::run_for(size_t steps, size_t max_steps, Engine engine) {
+    slice_start_ = steps_;
+    slice_end_ = steps_ + std::min(steps, std::numeric_limits<size_t>::max() - steps_);
+    if (engine == Engine::kSwitch) {
+        run(max_steps);
+    } else {
+        run_threaded(max_steps);
+    }
+    slice_end_ = std::numeric_limits<size_t>::max();
+    set_max_steps(max_steps_);
+    return ip_ >= code_.size();
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_profiled(size_t max_steps, Profile* profile) {
+    set_max_steps(max_steps);
+    while (ip_ < code_.size()) {
+        size_t ip = ip_;
+        // Loop ops and kEnd charge the static cost of their whole block; the
+        // profile uses per-op costs instead, so only pass on the rest.
+        size_t steps = steps_ + code_[ip].cost;
+        run_step();
+        profile->record(ip, steps_ - steps, ip_);
+    }
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_traced(size_t max_steps, TraceRecorder* trace) {
+    set_max_steps(max_steps);
+    while (ip_ < code_.size()) {
+        size_t ip = ip_;
+        const Op& op = code_[ip];
+        run_step();
+        switch (op.code) {
+            case OpCode::kLoopStart:
+                if (ip_ == ip + 1) {
+                    trace->enter(ip, tp_, steps_);
+                } else {
+                    trace->skip(ip, tp_, steps_);
+                }
+                break;
+            case OpCode::kLoopEnd:
+                if (ip_ == static_cast<size_t>(op.arg)) {
+                    trace->iterate(op.arg - 1, tp_, steps_);
+                } else {
+                    trace->exit(op.arg - 1, tp_, steps_);
+                }
+                break;
+            case OpCode::kIfEnd: trace->exit(op.arg - 1, tp_, steps_); break;
+            default: break;
+        }
+    }
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_detecting(size_t max_steps, LoopDetector* detector) {
+    // Watching every write costs, so the run alternates between threaded
+    // slices and watching for an eighth as many steps, both twice as long
+    // each round. A run that starts looping gets caught within about as
+    // many steps as it took before.
+    for (size_t slice = kDetectFirstSlice;; slice *= 2) {
+        if (run_for(slice, max_steps, Engine::kThreaded)) {
+            return;
+        }
+        detector->reset();
+        size_t watch_end = steps_ + slice / kDetectWatchFraction;
+        while (steps_ < watch_end) {
+            if (ip_ >= code_.size()) {
+                return;
+            }
+            const Op& op = code_[ip_];
+            switch (op.code) {
+                case OpCode::kAdd:
+                case OpCode::kClear:
+                case OpCode::kMulAdd: detector->write(tp_ + op.offset, tape_[tp_ + op.offset]); break;
+                case OpCode::kClearRange:
+                    for (int i = 0; i < op.arg; i++) {
+                        detector->write(tp_ + op.offset + i, tape_[tp_ + op.offset + i]);
+                    }
+                    break;
+                case OpCode::kInput: detector->input(); break;
+                default: break;
+            }
+            size_t ip = ip_;
+            run_step();
+            if (op.code == OpCode::kLoopEnd && ip_ == static_cast<size_t>(op.arg) &&
+                detector->back_edge(ip, tp_, tape_)) {
+                throw std::runtime_error("Infinite loop: the loop at " + detector->location(op.arg - 1) +
+                                         " came back to a state it was in before");
+            }
+        }
+    }
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_superinstructions(size_t max_steps, size_t warmup_ops, SuperinstructionPlan* plan) {
+    set_max_steps(max_steps);
+    std::vector<uint64_t> executions(code_.size());
+    for (size_t i = 0; i < warmup_ops && ip_ < code_.size(); i++) {
+        executions[ip_]++;
+        run_step();
+    }
+    *plan = SuperinstructionPlan(code_, executions);
+    if (ip_ < code_.size()) {
+        run_threaded(max_steps, plan);
+    }
+}
+
+#if defined(__GNUC__)
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_threaded(size_t max_steps, const SuperinstructionPlan* plan) {
+    set_max_steps(max_steps);
+    // Superinstructions by first op and then by second op, in the order add,
+    // move, clear, mul_add, loop_start, loop_end.
+    static const void* const fused_handlers[4][6] = {
+        {&&add_add, &&add_move, &&add_clear, &&add_mul_add, &&add_loop_start, &&add_loop_end},
+        {&&move_add, &&move_move, &&move_clear, &&move_mul_add, &&move_loop_start, &&move_loop_end},
+        {&&clear_add, &&clear_move, &&clear_clear, &&clear_mul_add, &&clear_loop_start, &&clear_loop_end},
+        {&&mul_add_add, &&mul_add_move, &&mul_add_clear, &&mul_add_mul_add, &&mul_add_loop_start, &&mul_add_loop_end},
+    };
+    auto fused_index = [](OpCode code) {
+        switch (code) {
+            case OpCode::kAdd: return 0;
+            case OpCode::kMove: return 1;
+            case OpCode::kClear: return 2;
+            case OpCode::kMulAdd: return 3;
+            case OpCode::kLoopStart: return 4;
+            default: return 5;
+        }
+    };
+    // Each op is replaced by the address of its handler, so dispatching the
+    // next op is a single indirect jump from the end of every handler. The
+    // translation is kept for the next slice of run_for().
+    if (threaded_code_.empty() || plan != threaded_plan_) {
+        threaded_code_.clear();
+        threaded_code_.reserve(code_.size());
+        for (size_t i = 0; i < code_.size(); i++) {
+            const Op& op = code_[i];
+            const void* handler = nullptr;
+            switch (op.code) {
+                case OpCode::kAdd: handler = &&add; break;
+                case OpCode::kMove: handler = &&move; break;
+                case OpCode::kClear: handler = &&clear; break;
+                case OpCode::kClearRange: handler = &&clear_range; break;
+                case OpCode::kMulAdd: handler = &&mul_add; break;
+                case OpCode::kScan: handler = &&scan; break;
+                case OpCode::kOutput: handler = &&output; break;
+                case OpCode::kInput: handler = &&input; break;
+                case OpCode::kLoopStart: handler = &&loop_start; break;
+                case OpCode::kLoopEnd: handler = &&loop_end; break;
+                case OpCode::kIfEnd: handler = &&if_end; break;
+                case OpCode::kEnd: handler = &&end; break;
+            }
+            // The second op keeps its own entry, so code can still jump to it.
+            if (plan != nullptr && plan->fused(i)) {
+                handler = fused_handlers[fused_index(op.code)][fused_index(code_[i + 1].code)];
+            }
+            threaded_code_.push_back(ThreadedOp{handler, &op});
+        }
+        threaded_plan_ = plan;
+    }
+    const std::vector<ThreadedOp>& code = threaded_code_;
+
+    uint64_t* block_counts = block_counts_.data();
+
+    const ThreadedOp* ip = code.data() + ip_;
+    const Op* op;
+#define DISPATCH() \
+    op = ip->op; \
+    goto *(ip++)->handler
+// Only ops that end a basic block carry a step cost, see Op::cost.
+#define CHARGE_BLOCK() \
+    steps_ += op->cost; \
+    block_counts[ip - code.data() - 1]++; \
+    if (steps_ >= stop_at_ || checkpoint_request_->load(std::memory_order_relaxed)) { \
+        ip_ = ip - code.data(); \
+        if (!block_limit(op->cost)) { \
+            return; \
+        } \
+    }
+
+#define ADD() tape_[tp_ + op->offset] += op->arg
+#define MOVE() tp_ += op->arg
+#define CLEAR() { \
+    Cell& cell = tape_[tp_ + op->offset]; \
+    steps_ += static_cast<size_t>(op->iteration_cost) * cell; \
+    cell = 0; \
+}
+#define MUL_ADD() { \
+    Cell value = tape_[tp_]; \
+    tape_[tp_ + op->offset] += multiply(value, op->arg); \
+}
+// A superinstruction runs its first op and then goes straight on to the
+// handler of the second one, which saves the indirect jump between them.
+#define FUSED_NEXT(second) \
+    op++; \
+    ip++; \
+    goto second
+#define SUPERINSTRUCTIONS(first, FIRST) \
+first##_add: FIRST(); FUSED_NEXT(add); \
+first##_move: FIRST(); FUSED_NEXT(move); \
+first##_clear: FIRST(); FUSED_NEXT(clear); \
+first##_mul_add: FIRST(); FUSED_NEXT(mul_add); \
+first##_loop_start: FIRST(); FUSED_NEXT(loop_start); \
+first##_loop_end: FIRST(); FUSED_NEXT(loop_end);
+
+    DISPATCH();
+add:
+    ADD();
+    DISPATCH();
+move:
+    MOVE();
+    DISPATCH();
+clear:
+    CLEAR();
+    DISPATCH();
+mul_add:
+    MUL_ADD();
+    DISPATCH();
+clear_range:
+    tape_.clear(tp_ + op->offset, op->arg);
+    DISPATCH();
+scan: {
+    int end = tape_.find_zero(tp_, op->arg);
+    steps_ += static_cast<size_t>((end - tp_) / op->arg) * op->iteration_cost;
+    tp_ = end;
+    DISPATCH();
+}
+output:
+    this->output();
+    DISPATCH();
+input:
+    this->input();
+    DISPATCH();
+loop_start:
+    CHARGE_BLOCK();
+    if (tape_[tp_] == 0) {
+        ip = code.data() + op->arg;
+    }
+    DISPATCH();
+loop_end:
+    CHARGE_BLOCK();
+    if (tape_[tp_] != 0) {
+        ip = code.data() + op->arg;
+    }
+    DISPATCH();
+if_end:
+    CHARGE_BLOCK();
+    DISPATCH();
+end:
+    CHARGE_BLOCK();
+    ip_ = code_.size();
+    return;
+SUPERINSTRUCTIONS(add, ADD)
+SUPERINSTRUCTIONS(move, MOVE)
+SUPERINSTRUCTIONS(clear, CLEAR)
+SUPERINSTRUCTIONS(mul_add, MUL_ADD)
+#undef SUPERINSTRUCTIONS
+#undef FUSED_NEXT
+#undef MUL_ADD
+#undef CLEAR
+#undef MOVE
+#undef ADD
+#undef CHARGE_BLOCK
+#undef DISPATCH
+}
+#else
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_threaded(size_t max_steps, const SuperinstructionPlan*) {
+    // Computed goto is a GNU extension; other compilers use the switch loop.
+    run(max_steps);
+}
+#endif
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_jit(size_t max_steps) {
+    // Native code can neither stop for a checkpoint nor start in the middle
+    // of a resumed program, and it only knows 32-bit cells and offsets that
+    // fit an operand.
+    if constexpr (!std::is_same_v<Cell, Word>) {
+        run_threaded(max_steps);
+    } else if (!Jit::supports(code_) || !checkpoint_path_.empty() || ip_ != 0) {
+        run_threaded(max_steps);
+    } else {
+        set_max_steps(max_steps);
+        Jit jit(code_, block_counts_.data());
+        run_native(jit, false);
+        ip_ = code_.size();
+    }
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_native(const Jit& jit, bool from_loop_body) {
+    // Explicit instantiation compiles this for every width, but it is only
+    // called for 32-bit cells.
+    if constexpr (std::is_same_v<Cell, Word>) {
+        JitContext ctx{};
+        ctx.tape = &tape_;
+        ctx.tp = tp_;
+        ctx.steps = steps_;
+        ctx.max_steps = max_steps_;
+        ctx.io = this;
+        ctx.output = &BrainfuckInterpreter::jit_output;
+        ctx.input = &BrainfuckInterpreter::jit_input;
+        bool finished = from_loop_body ? jit.run_loop_body(&ctx) : jit.run(&ctx);
+        tp_ = ctx.tp;
+        steps_ = ctx.steps;
+        if (ctx.failed) {
+            throw std::runtime_error(jit_input_error_);
+        }
+        if (!finished) {
+            fail_max_steps(max_steps_);
+        }
+    }
+}
+
+template <typename Cell>
+void BrainfuckInterpreter<Cell>::run_tiered(size_t max_steps) {
+    set_max_steps(max_steps);
+    bool native = std::is_same_v<Cell, Word> && Jit::supports(code_) && checkpoint_path_.empty();
+    std::vector<uint32_t> back_edges(code_.size());
+    // Compiled loops by the index of their kLoopStart.
+    std::vector<std::unique_ptr<Jit>> loops(code_.size());
+    while (ip_ < code_.size()) {
+        size_t ip = ip_;
+        const Op& op = code_[ip];
+        if constexpr (std::is_same_v<Cell, Word>) {
+            if (op.code == OpCode::kLoopStart && loops[ip] != nullptr) {
+                run_native(*loops[ip], false);
+                ip_ = op.arg;
+                continue;
+            }
+        }
+        run_step();
+        if (op.code != OpCode::kLoopEnd || ip_ != static_cast<size_t>(op.arg) ||
+            ++back_edges[ip] < kHotLoopBackEdges) {
+            continue;
+        }
+        if (!native) {
+            run_threaded(max_steps);
+            return;
+        }
+        if constexpr (std::is_same_v<Cell, Word>) {
+            // The back-edge was just taken, so go on in the loop's body.
+            size_t start = op.arg - 1;
+            loops[start] = std::make_unique<Jit>(std::vector<Op>(code_.begin() + start, code_.begin() + ip + 1),
+                                                 block_counts_.data() + start);
+            run_native(*loops[start], true);
+            ip_ = ip + 1;
+        }
+    }
+}
+
+template class BrainfuckInterpreter<uint8_t>;
+template class BrainfuckInterpreter<uint16_t>;
+template class BrainfuckInterpreter<uint32_t>;
+template class BrainfuckInterpreter<uint64_t>;
@@ -0,0 +1,153 @@
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+#include "bytecode.hpp"
+#include "io.hpp"
+#include "jit.hpp"
+#include "loop_detector.hpp"
+#include "profile.hpp"
+#include "superinstructions.hpp"
+#include "tape.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+// How a program runs, see BrainfuckInterpreter.
+enum class Engine { kSwitch, kThreaded, kJit, kTiered };
+
+// Set by SIGUSR1; the interpreters that have checkpoints enabled write one at
+// the next block end. The others never touch it, so interpreters on other
+// threads do not race with the signal handler.
+extern std::atomic<int> checkpoint_requested;
+
+// Cell is the unsigned type of one tape cell. Every width gets its own copy
+// of the engines, so their inner loops never check the width; they are
+// instantiated for 8, 16, 32 and 64 bits in interpreter.cc. Running out of
+// steps or input throws std::runtime_error.
+template <typename Cell>
+class BrainfuckInterpreter {
+public:
+    BrainfuckInterpreter(std::string code, BufferedIo* io);
+    BrainfuckInterpreter(std::vector<Op> code, BufferedIo* io);
+    // returns true if there are more step to run, false at the end or when
+    // a slice of run_for() is used up.
+    bool run_step();
+    // runs to the end.
+    void run(size_t max_steps);
+    // runs like run() with kSwitch and like run_threaded() otherwise, but
+    // returns at the first block end that would take the run past steps more
+    // steps; the next call goes on from there. A slice always runs at least
+    // one block. Native code cannot stop in between, so kJit and kTiered run
+    // threaded here. Returns true once the program has ended.
+    bool run_for(size_t steps, size_t max_steps, Engine engine);
+    // runs to the end with direct-threaded dispatch instead of run_step(),
+    // running the pairs of ops that plan fuses as superinstructions.
+    void run_threaded(size_t max_steps, const SuperinstructionPlan* plan = nullptr);
+    // runs warmup_ops ops with run_step() while counting how often each op
+    // runs, stores the resulting plan and runs the rest with run_threaded().
+    void run_superinstructions(size_t max_steps, size_t warmup_ops, SuperinstructionPlan* plan);
+    // runs to the end as native code, or with run_threaded() if there is no
+    // jit for this platform or the jit cannot compile the code.
+    void run_jit(size_t max_steps);
+    // runs with run_step() until a loop has jumped back kHotLoopBackEdges
+    // times, then compiles that loop to native code and runs it there; the
+    // compiled loop is reused whenever the loop is entered again. Without a
+    // jit, the first hot loop switches the rest of the run to run_threaded().
+    void run_tiered(size_t max_steps);
+    // runs to the end like run() and records every op in profile.
+    void run_profiled(size_t max_steps, Profile* profile);
+    // runs to the end like run_threaded(), but throws std::runtime_error
+    // once detector has proven that the run loops forever. Only part of the
+    // run is watched, see interpreter.cc.
+    void run_detecting(size_t max_steps, LoopDetector* detector);
+    // runs to the end like run() and records every loop op in trace.
+    void run_traced(size_t max_steps, TraceRecorder* trace);
+    size_t steps() const { return steps_; }
+    const std::vector<Op>& code() const { return code_; }
+    // How often the block that ends at each op ran, by the index of that
+    // loop op or kEnd; 0 for the other ops. A block counts once its end is
+    // reached, so one cut short by an error does not. Counting is one
+    // increment per block in every engine, so it is always on.
+    const std::vector<uint64_t>& block_counts() const { return block_counts_; }
+    const BasicTape<Cell>& tape() const { return tape_; }
+    int tape_pointer() const { return tp_; }
+    BasicTape<Cell>& mutable_tape() { return tape_; }
+    // Continues a run that another engine started: the next op is ip, the
+    // tape pointer tp and steps have run so far. The cells go through
+    // mutable_tape() before, see LockstepInterpreter::hand_over().
+    void restore(size_t ip, int tp, size_t steps);
+    // Saves a checkpoint to path on SIGUSR1 and, unless every is 0, every
+    // that many steps. Checkpoints are taken at block ends, so they can be up
+    // to one block late.
+    void enable_checkpoints(std::string path, size_t every);
+    // Restores the state saved by a checkpoint and skips the input the saved
+    // run had consumed. Throws std::runtime_error.
+    void resume(const std::string& path);
+private:
+    struct ThreadedOp {
+        const void* handler;
+        const Op* op;
+    };
+
+    void output();
+    void input();
+    static void jit_output(void* self, Word value);
+    static Word jit_input(void* self, Word current, bool* failed);
+    // Runs jit, compiled from the code at ip_, on this interpreter's state;
+    // see Jit::run_loop_body() for from_loop_body. Does nothing unless cells
+    // are 32 bits wide.
+    void run_native(const Jit& jit, bool from_loop_body);
+    [[noreturn]] void fail_max_steps(size_t max_steps);
+    // Returns false if the op must not run because the slice is used up.
+    bool charge_block(size_t cost) {
+        steps_ += cost;
+        block_counts_[ip_ - 1]++;
+        if (steps_ >= stop_at_ || checkpoint_request_->load(std::memory_order_relaxed)) {
+            return block_limit(cost);
+        }
+        return true;
+    }
+    // Called by the op before ip_ that just charged cost when the step budget
+    // or the slice is used up or a checkpoint is due. Returns false after
+    // rewinding to the state before the op if the slice ends there.
+    bool block_limit(size_t cost);
+    void save_block_checkpoint(size_t cost);
+    void set_max_steps(size_t max_steps);
+
+    BufferedIo* io_;
+    // Why input failed under run_native(), which throws it once the
+    // generated code has returned.
+    std::string jit_input_error_;
+    std::vector<Op> code_;
+    // See block_counts(); Jits write into it too.
+    std::vector<uint64_t> block_counts_;
+    size_t ip_ = 0;
+    BasicTape<Cell> tape_;
+    int tp_ = 0;
+    size_t steps_ = 0;
+    size_t max_steps_ = std::numeric_limits<size_t>::max();
+    // min(max_steps_, next_checkpoint_, slice_end_), so block ends compare
+    // only once.
+    size_t stop_at_ = std::numeric_limits<size_t>::max();
+    size_t slice_start_ = 0;
+    size_t slice_end_ = std::numeric_limits<size_t>::max();
+    std::string checkpoint_path_;
+    // checkpoint_requested once checkpoints are enabled, a flag that is never
+    // set before.
+    const std::atomic<int>* checkpoint_request_;
+    size_t checkpoint_every_ = 0;
+    size_t next_checkpoint_ = std::numeric_limits<size_t>::max();
+    std::vector<ThreadedOp> threaded_code_;
+    const SuperinstructionPlan* threaded_plan_ = nullptr;
+};
+
+extern template class BrainfuckInterpreter<uint8_t>;
+extern template class BrainfuckInterpreter<uint16_t>;
+extern template class BrainfuckInterpreter<uint32_t>;
+extern template class BrainfuckInterpreter<uint64_t>;
+
+#endif  // INTERPRETER_HPP
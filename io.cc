@@ -0,0 +1,83 @@
+#include "io.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+
+BufferedIo::BufferedIo(int in_fd, int out_fd, EofBehavior eof, bool line_buffered)
+    : BufferedIo(
+          [in_fd](char* data, size_t size) -> size_t {
+              while (true) {
+                  ssize_t n = ::read(in_fd, data, size);
+                  if (n < 0 && errno == EINTR) {
+                      continue;
+                  }
+                  return n > 0 ? n : 0;
+              }
+          },
+          [out_fd](const char* data, size_t size) {
+              size_t written = 0;
+              while (written < size) {
+                  ssize_t n = ::write(out_fd, data + written, size - written);
+                  if (n < 0) {
+                      if (errno == EINTR) {
+                          continue;
+                      }
+                      // Nobody is listening any more (e.g. a closed pipe);
+                      // drop the output like the unbuffered interpreter
+                      // would.
+                      break;
+                  }
+                  written += n;
+              }
+          },
+          eof, line_buffered) {}
+
+BufferedIo::BufferedIo(ReadFunction read, WriteFunction write, EofBehavior eof, bool line_buffered,
+                       size_t buffer_size)
+    : read_(std::move(read)), write_(std::move(write)), eof_(eof), line_buffered_(line_buffered),
+      output_(buffer_size), input_(buffer_size) {}
+
+BufferedIo::~BufferedIo() {
+    flush();
+}
+
+void BufferedIo::flush() {
+    if (output_size_ > 0) {
+        write_(output_.data(), output_size_);
+    }
+    output_base_ += output_size_;
+    output_size_ = 0;
+}
+
+bool BufferedIo::fill() {
+    input_base_ += input_size_;
+    input_pos_ = 0;
+    input_size_ = read_(input_.data(), input_.size());
+    return input_size_ > 0;
+}
+
+int BufferedIo::read() {
+    // Whatever the program printed so far may be the prompt for this input.
+    flush();
+    if (input_pos_ == input_size_ && !fill()) {
+        switch (eof_) {
+            case EofBehavior::kError: throw std::runtime_error("No input available from stdin");
+            case EofBehavior::kZero: return 0;
+            case EofBehavior::kUnchanged: return -1;
+        }
+    }
+    return static_cast<unsigned char>(input_[input_pos_++]);
+}
+
+bool BufferedIo::skip_input(size_t count) {
+    while (count > 0) {
+        if (input_pos_ == input_size_ && !fill()) {
+            return false;
+        }
+        size_t skipped = std::min(count, input_size_ - input_pos_);
+        input_pos_ += skipped;
+        count -= skipped;
+    }
+    return true;
+}
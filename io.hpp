@@ -0,0 +1,74 @@
+#ifndef IO_HPP
+#define IO_HPP
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// What ',' stores once the input is exhausted.
+enum class EofBehavior {
+    kError,      // read() throws std::runtime_error
+    kZero,       // store 0
+    kUnchanged,  // leave the cell as it is
+};
+
+// Buffers program output and input on raw file descriptors or callbacks, so
+// that '.' and ',' do not cost a system call each. Output is flushed when the
+// buffer is full, before every read, on destruction, and after each '\n' if
+// line_buffered is set.
+class BufferedIo {
+public:
+    static constexpr size_t kBufferSize = 1 << 16;
+
+    // Stores up to size bytes of input at data and returns how many it
+    // stored; 0 means the input has ended.
+    using ReadFunction = std::function<size_t(char* data, size_t size)>;
+    // Takes the size bytes of output at data.
+    using WriteFunction = std::function<void(const char* data, size_t size)>;
+
+    BufferedIo(int in_fd, int out_fd, EofBehavior eof = EofBehavior::kError, bool line_buffered = false);
+    // For programs embedded in another process; buffer_size bytes of input
+    // and of output are buffered between calls.
+    BufferedIo(ReadFunction read, WriteFunction write, EofBehavior eof = EofBehavior::kError,
+               bool line_buffered = false, size_t buffer_size = kBufferSize);
+    ~BufferedIo();
+    BufferedIo(const BufferedIo&) = delete;
+    BufferedIo& operator=(const BufferedIo&) = delete;
+
+    void write(char c) {
+        output_[output_size_++] = c;
+        if (output_size_ == output_.size() || (line_buffered_ && c == '\n')) {
+            flush();
+        }
+    }
+    // Returns the byte ',' stores, or -1 if it should leave the cell as it is.
+    // Throws std::runtime_error at the end of the input with kError.
+    int read();
+    void flush();
+    // Number of input bytes ',' has consumed so far.
+    size_t input_offset() const { return input_base_ + input_pos_; }
+    // Number of bytes '.' has written so far, flushed or not.
+    size_t output_offset() const { return output_base_ + output_size_; }
+    // Consumes count bytes of input without storing them anywhere, to pick up
+    // a resumed run where it left off. Returns false if the input ends first.
+    bool skip_input(size_t count);
+
+private:
+    bool fill();
+
+    ReadFunction read_;
+    WriteFunction write_;
+    EofBehavior eof_;
+    bool line_buffered_;
+    std::vector<char> output_;
+    size_t output_size_ = 0;
+    // Bytes flushed before output_[0].
+    size_t output_base_ = 0;
+    std::vector<char> input_;
+    size_t input_pos_ = 0;
+    size_t input_size_ = 0;
+    // Offset in the input stream of input_[0].
+    size_t input_base_ = 0;
+};
+
+#endif  // IO_HPP
@@ -0,0 +1,483 @@
+#include "jit.hpp"
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define BFI_JIT_X86_64 1
+#endif
+
+namespace {
+
+void refresh(JitContext* ctx) {
+    ctx->cells = ctx->tape->zero_cell();
+    ctx->begin = ctx->tape->begin_index();
+    ctx->end = ctx->tape->end_index();
+}
+
+// Helpers called from generated code. They take the context first so that the
+// generated code only has to set up the remaining argument registers.
+void jit_ensure(JitContext* ctx, int64_t index) {
+    ctx->tape->ensure(static_cast<int>(index));
+    refresh(ctx);
+}
+
+void jit_output(JitContext* ctx, Word value) {
+    ctx->output(ctx->io, value);
+}
+
+Word jit_input(JitContext* ctx, Word current) {
+    return ctx->input(ctx->io, current, &ctx->failed);
+}
+
+int64_t jit_scan(JitContext* ctx, int64_t tp, int64_t stride, uint64_t iteration_cost) {
+    int end = ctx->tape->find_zero(static_cast<int>(tp), static_cast<int>(stride));
+    ctx->steps += static_cast<uint64_t>((end - tp) / stride) * iteration_cost;
+    jit_ensure(ctx, end);
+    return end;
+}
+
+#ifdef BFI_JIT_X86_64
+
+// Step costs sit on the ops that end basic blocks (see Op::cost) and are
+// added to r14 there, so the budget is checked once per loop iteration.
+//
+// Register assignment of the generated code. All of them are callee-saved
+// in the System V ABI, so they survive calls into the helpers.
+//   rbx  JitContext*
+//   r12  pointer to cell 0
+//   r13  tape pointer (cell index)
+//   r14  steps
+//   r15  max_steps
+class Assembler {
+public:
+    const std::vector<uint8_t>& bytes() const { return bytes_; }
+    size_t pos() const { return bytes_.size(); }
+
+    void emit(std::initializer_list<uint8_t> bytes) {
+        bytes_.insert(bytes_.end(), bytes);
+    }
+    void emit32(uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            bytes_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+    void emit64(uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            bytes_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+    // Emits a jump with a rel32 displacement and returns the displacement's
+    // position for patch().
+    size_t jump(std::initializer_list<uint8_t> opcode) {
+        emit(opcode);
+        size_t at = pos();
+        emit32(0);
+        return at;
+    }
+    void jump_to(std::initializer_list<uint8_t> opcode, size_t target) {
+        patch(jump(opcode), target);
+    }
+    void patch(size_t at, size_t target) {
+        int32_t rel = static_cast<int32_t>(target - (at + 4));
+        std::memcpy(&bytes_[at], &rel, sizeof(rel));
+    }
+
+    // ModRM and SIB bytes for [r12 + r13 * 4 + disp]; the instruction's REX
+    // prefix must set X and B.
+    void cell_operand(uint8_t reg, int32_t disp) {
+        if (disp == 0) {
+            emit({static_cast<uint8_t>(0x04 | reg << 3), 0xAC});
+        } else if (disp >= -128 && disp <= 127) {
+            emit({static_cast<uint8_t>(0x44 | reg << 3), 0xAC, static_cast<uint8_t>(disp)});
+        } else {
+            emit({static_cast<uint8_t>(0x84 | reg << 3), 0xAC});
+            emit32(disp);
+        }
+    }
+    void call(const void* function) {
+        emit({0x48, 0xB8});  // mov rax, imm64
+        emit64(reinterpret_cast<uint64_t>(function));
+        emit({0xFF, 0xD0});  // call rax
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+};
+
+constexpr uint8_t kEax = 0;
+constexpr uint8_t kEsi = 6;
+constexpr uint8_t kEdi = 7;
+// Longer clear ranges use rep stosd.
+constexpr int32_t kMaxUnrolledClear = 8;
+
+uint8_t context_offset(size_t offset) {
+    return static_cast<uint8_t>(offset);
+}
+
+// Whether cell offset can be addressed as [r12 + r13 * 4 + offset * 4].
+bool displacement_fits(int64_t offset) {
+    return offset <= INT32_MAX / 4 && offset >= INT32_MIN / 4;
+}
+
+class Compiler {
+public:
+    std::vector<uint8_t> compile(const std::vector<Op>& code, uint64_t* block_counts) {
+        block_counts_ = block_counts;
+        prologue();
+        for (size_t ip = 0; ip < code.size(); ip++) {
+            compile_op(code[ip], ip);
+        }
+        flush_cost();
+        check_steps();
+        epilogue(1);
+        size_t out_of_steps = a_.pos();
+        for (size_t at : out_of_steps_jumps_) {
+            a_.patch(at, out_of_steps);
+        }
+        for (size_t at : input_failed_jumps_) {
+            a_.patch(at, out_of_steps);
+        }
+        epilogue(0);
+        if (first_loop_body_ != 0) {
+            // A second entry point that skips the test of the first loop.
+            loop_body_entry_ = a_.pos();
+            prologue();
+            a_.jump_to({0xE9}, first_loop_body_);  // jmp loop body
+        }
+        return a_.bytes();
+    }
+
+    // Offset of the entry point for Jit::run_loop_body(), or 0 if the code
+    // has no loop.
+    size_t loop_body_entry() const { return loop_body_entry_; }
+
+private:
+    void prologue() {
+        a_.emit({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});  // push rbx..r15
+        a_.emit({0x48, 0x83, 0xEC, 0x08});  // sub rsp, 8 (keeps calls 16-byte aligned)
+        a_.emit({0x48, 0x89, 0xFB});  // mov rbx, rdi
+        a_.emit({0x4C, 0x8B, 0x63, context_offset(offsetof(JitContext, cells))});  // mov r12, [rbx+cells]
+        a_.emit({0x4C, 0x8B, 0x6B, context_offset(offsetof(JitContext, tp))});  // mov r13, [rbx+tp]
+        a_.emit({0x4C, 0x8B, 0x73, context_offset(offsetof(JitContext, steps))});  // mov r14, [rbx+steps]
+        a_.emit({0x4C, 0x8B, 0x7B, context_offset(offsetof(JitContext, max_steps))});  // mov r15, [rbx+max_steps]
+    }
+
+    void epilogue(uint32_t result) {
+        a_.emit({0x4C, 0x89, 0x6B, context_offset(offsetof(JitContext, tp))});  // mov [rbx+tp], r13
+        a_.emit({0x4C, 0x89, 0x73, context_offset(offsetof(JitContext, steps))});  // mov [rbx+steps], r14
+        a_.emit({0xB8});  // mov eax, result
+        a_.emit32(result);
+        a_.emit({0x48, 0x83, 0xC4, 0x08});  // add rsp, 8
+        a_.emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B});  // pop r15..rbx
+        a_.emit({0xC3});  // ret
+    }
+
+    void flush_cost() {
+        if (pending_cost_ != 0) {
+            a_.emit({0x49, 0x81, 0xC6});  // add r14, imm32
+            a_.emit32(static_cast<uint32_t>(pending_cost_));
+            pending_cost_ = 0;
+        }
+    }
+
+    void add_cost(uint32_t cost) {
+        pending_cost_ += cost;
+        if (pending_cost_ > (1u << 30)) {
+            flush_cost();
+        }
+    }
+
+    void check_steps() {
+        a_.emit({0x4D, 0x39, 0xFE});  // cmp r14, r15
+        out_of_steps_jumps_.push_back(a_.jump({0x0F, 0x83}));  // jae out_of_steps
+    }
+
+    // Counts one run of the block that ends at op ip.
+    void count_block(size_t ip) {
+        a_.emit({0x48, 0xB8});  // mov rax, imm64
+        a_.emit64(reinterpret_cast<uint64_t>(block_counts_ + ip));
+        a_.emit({0x48, 0xFF, 0x00});  // inc qword [rax]
+    }
+
+    void reload_cells() {
+        a_.emit({0x4C, 0x8B, 0x63, context_offset(offsetof(JitContext, cells))});  // mov r12, [rbx+cells]
+    }
+
+    // Grows the tape if cell tp + offset is not backed by memory yet.
+    void ensure(int32_t offset) {
+        a_.emit({0x49, 0x8D, 0x85});  // lea rax, [r13+offset]
+        a_.emit32(offset);
+        a_.emit({0x48, 0x3B, 0x43, context_offset(offsetof(JitContext, begin))});  // cmp rax, [rbx+begin]
+        size_t below = a_.jump({0x0F, 0x8C});  // jl slow
+        a_.emit({0x48, 0x3B, 0x43, context_offset(offsetof(JitContext, end))});  // cmp rax, [rbx+end]
+        size_t inside = a_.jump({0x0F, 0x8C});  // jl done
+        a_.patch(below, a_.pos());
+        a_.emit({0x48, 0x89, 0xC6});  // mov rsi, rax
+        a_.emit({0x48, 0x89, 0xDF});  // mov rdi, rbx
+        a_.call(reinterpret_cast<const void*>(&jit_ensure));
+        reload_cells();
+        a_.patch(inside, a_.pos());
+    }
+
+    // Like ensure(), but skips the check if tp + offset is known to be backed
+    // already. The tape is contiguous and never shrinks, so all cells between
+    // two checked ones are backed too until tp moves.
+    void ensure_cell(int32_t offset) {
+        if (offset >= ensured_low_ && offset <= ensured_high_) {
+            return;
+        }
+        ensure(offset);
+        ensured_low_ = std::min(ensured_low_, offset);
+        ensured_high_ = std::max(ensured_high_, offset);
+    }
+
+    // Only the cell at tp is known to be backed, e.g. after a move or where
+    // control flow joins.
+    void forget_ensured() {
+        ensured_low_ = 0;
+        ensured_high_ = 0;
+    }
+
+    static int32_t cell_displacement(int32_t offset) {
+        if (!displacement_fits(offset)) {
+            throw std::invalid_argument("cell offset out of range for jit: " + std::to_string(offset));
+        }
+        return offset * 4;
+    }
+
+    void compile_op(const Op& op, size_t ip) {
+        add_cost(op.cost);
+        switch (op.code) {
+            case OpCode::kAdd:
+                ensure_cell(op.offset);
+                a_.emit({0x43, 0x81});  // add dword [cell+offset], imm32
+                a_.cell_operand(0, cell_displacement(op.offset));
+                a_.emit32(op.arg);
+                break;
+            case OpCode::kMove:
+                a_.emit({0x49, 0x81, 0xC5});  // add r13, imm32
+                a_.emit32(op.arg);
+                ensure(0);
+                forget_ensured();
+                break;
+            case OpCode::kClear:
+                ensure_cell(op.offset);
+                if (op.iteration_cost != 0) {
+                    a_.emit({0x43, 0x8B});  // mov eax, [cell+offset]
+                    a_.cell_operand(kEax, cell_displacement(op.offset));
+                    a_.emit({0x48, 0x69, 0xC0});  // imul rax, rax, imm32
+                    a_.emit32(op.iteration_cost);
+                    a_.emit({0x49, 0x01, 0xC6});  // add r14, rax
+                }
+                a_.emit({0x43, 0xC7});  // mov dword [cell+offset], 0
+                a_.cell_operand(0, cell_displacement(op.offset));
+                a_.emit32(0);
+                break;
+            case OpCode::kClearRange:
+                ensure_cell(op.offset);
+                ensure_cell(op.offset + op.arg - 1);
+                if (op.arg <= kMaxUnrolledClear) {
+                    for (int32_t i = 0; i < op.arg; i++) {
+                        a_.emit({0x43, 0xC7});  // mov dword [cell+offset+i], 0
+                        a_.cell_operand(0, cell_displacement(op.offset + i));
+                        a_.emit32(0);
+                    }
+                    break;
+                }
+                a_.emit({0x4B, 0x8D});  // lea rdi, [cell+offset]
+                a_.cell_operand(kEdi, cell_displacement(op.offset));
+                a_.emit({0xB9});  // mov ecx, imm32
+                a_.emit32(op.arg);
+                a_.emit({0x31, 0xC0});  // xor eax, eax
+                a_.emit({0xF3, 0xAB});  // rep stosd
+                break;
+            case OpCode::kMulAdd:
+                ensure_cell(op.offset);
+                a_.emit({0x43, 0x8B});  // mov eax, [cell]
+                a_.cell_operand(kEax, 0);
+                a_.emit({0x69, 0xC0});  // imul eax, eax, imm32
+                a_.emit32(op.arg);
+                a_.emit({0x43, 0x01});  // add [cell+offset], eax
+                a_.cell_operand(kEax, cell_displacement(op.offset));
+                break;
+            case OpCode::kScan:
+                a_.emit({0x4C, 0x89, 0x73, context_offset(offsetof(JitContext, steps))});  // mov [rbx+steps], r14
+                a_.emit({0x48, 0x89, 0xDF});  // mov rdi, rbx
+                a_.emit({0x4C, 0x89, 0xEE});  // mov rsi, r13
+                a_.emit({0x48, 0xC7, 0xC2});  // mov rdx, imm32
+                a_.emit32(op.arg);
+                a_.emit({0x48, 0xC7, 0xC1});  // mov rcx, imm32
+                a_.emit32(op.iteration_cost);
+                a_.call(reinterpret_cast<const void*>(&jit_scan));
+                a_.emit({0x49, 0x89, 0xC5});  // mov r13, rax
+                a_.emit({0x4C, 0x8B, 0x73, context_offset(offsetof(JitContext, steps))});  // mov r14, [rbx+steps]
+                reload_cells();
+                forget_ensured();
+                break;
+            case OpCode::kOutput:
+                a_.emit({0x43, 0x8B});  // mov esi, [cell]
+                a_.cell_operand(kEsi, 0);
+                a_.emit({0x48, 0x89, 0xDF});  // mov rdi, rbx
+                a_.call(reinterpret_cast<const void*>(&jit_output));
+                break;
+            case OpCode::kInput:
+                a_.emit({0x43, 0x8B});  // mov esi, [cell]
+                a_.cell_operand(kEsi, 0);
+                a_.emit({0x48, 0x89, 0xDF});  // mov rdi, rbx
+                a_.call(reinterpret_cast<const void*>(&jit_input));
+                a_.emit({0x80, 0x7B, context_offset(offsetof(JitContext, failed)), 0x00});  // cmp byte [rbx+failed], 0
+                input_failed_jumps_.push_back(a_.jump({0x0F, 0x85}));  // jne out_of_steps
+                a_.emit({0x43, 0x89});  // mov [cell], eax
+                a_.cell_operand(kEax, 0);
+                break;
+            case OpCode::kLoopStart: {
+                flush_cost();
+                count_block(ip);
+                a_.emit({0x43, 0x83});  // cmp dword [cell], 0
+                a_.cell_operand(7, 0);
+                a_.emit({0x00});
+                size_t exit = a_.jump({0x0F, 0x84});  // je loop exit
+                loops_.push_back(Loop{exit, a_.pos()});
+                if (first_loop_body_ == 0) {
+                    first_loop_body_ = a_.pos();
+                }
+                forget_ensured();
+                break;
+            }
+            case OpCode::kLoopEnd: {
+                flush_cost();
+                count_block(ip);
+                check_steps();
+                Loop loop = loops_.back();
+                loops_.pop_back();
+                a_.emit({0x43, 0x83});  // cmp dword [cell], 0
+                a_.cell_operand(7, 0);
+                a_.emit({0x00});
+                a_.jump_to({0x0F, 0x85}, loop.body);  // jne loop body
+                a_.patch(loop.exit_jump, a_.pos());
+                forget_ensured();
+                break;
+            }
+            case OpCode::kIfEnd: {
+                // No back-edge, so no budget check either.
+                flush_cost();
+                count_block(ip);
+                Loop loop = loops_.back();
+                loops_.pop_back();
+                a_.patch(loop.exit_jump, a_.pos());
+                forget_ensured();
+                break;
+            }
+            case OpCode::kEnd:
+                count_block(ip);
+                break;
+        }
+    }
+
+    struct Loop {
+        size_t exit_jump;
+        size_t body;
+    };
+
+    Assembler a_;
+    std::vector<Loop> loops_;
+    std::vector<size_t> out_of_steps_jumps_;
+    std::vector<size_t> input_failed_jumps_;
+    uint32_t pending_cost_ = 0;
+    size_t first_loop_body_ = 0;
+    size_t loop_body_entry_ = 0;
+    uint64_t* block_counts_ = nullptr;
+    // Offsets from tp between which every cell is known to be backed.
+    int32_t ensured_low_ = 0;
+    int32_t ensured_high_ = 0;
+};
+
+#endif  // BFI_JIT_X86_64
+
+}  // namespace
+
+#ifdef BFI_JIT_X86_64
+
+bool Jit::supported() {
+    return true;
+}
+
+bool Jit::supports(const std::vector<Op>& code) {
+    for (const Op& op : code) {
+        int64_t last = op.code == OpCode::kClearRange ? int64_t{op.offset} + op.arg - 1 : op.offset;
+        if (!displacement_fits(op.offset) || !displacement_fits(last)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Jit::Jit(const std::vector<Op>& code, uint64_t* block_counts) {
+    Compiler compiler;
+    std::vector<uint8_t> bytes = compiler.compile(code, block_counts);
+    loop_body_entry_ = compiler.loop_body_entry();
+    size_ = bytes.size();
+    mapped_size_ = size_;
+    memory_ = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory_ == MAP_FAILED) {
+        memory_ = nullptr;
+        throw std::runtime_error("could not map " + std::to_string(mapped_size_) + " bytes for jit code");
+    }
+    std::memcpy(memory_, bytes.data(), size_);
+    if (mprotect(memory_, mapped_size_, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory_, mapped_size_);
+        memory_ = nullptr;
+        throw std::runtime_error("could not make jit code executable");
+    }
+}
+
+Jit::~Jit() {
+    if (memory_ != nullptr) {
+        munmap(memory_, mapped_size_);
+    }
+}
+
+bool Jit::run(JitContext* ctx) const {
+    jit_ensure(ctx, ctx->tp);
+    auto entry = reinterpret_cast<uint32_t (*)(JitContext*)>(memory_);
+    return entry(ctx) != 0;
+}
+
+bool Jit::run_loop_body(JitContext* ctx) const {
+    if (loop_body_entry_ == 0) {
+        throw std::invalid_argument("jit code does not start with a loop");
+    }
+    jit_ensure(ctx, ctx->tp);
+    auto entry = reinterpret_cast<uint32_t (*)(JitContext*)>(static_cast<uint8_t*>(memory_) + loop_body_entry_);
+    return entry(ctx) != 0;
+}
+
+#else
+
+bool Jit::supported() {
+    return false;
+}
+
+bool Jit::supports(const std::vector<Op>& code) {
+    return false;
+}
+
+Jit::Jit(const std::vector<Op>& code, uint64_t* block_counts) {
+    throw std::runtime_error("jit is only supported on x86-64 unix");
+}
+
+Jit::~Jit() {}
+
+bool Jit::run(JitContext* ctx) const {
+    return false;
+}
+
+bool Jit::run_loop_body(JitContext* ctx) const {
+    return false;
+}
+
+#endif  // BFI_JIT_X86_64
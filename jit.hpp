@@ -0,0 +1,61 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "bytecode.hpp"
+#include "tape.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// State shared between the generated code and its C++ helpers. The layout is
+// part of the generated code's ABI, see jit.cc.
+struct JitContext {
+    Word* cells;  // cell 0, valid for indices in [begin, end)
+    int64_t begin;
+    int64_t end;
+    int64_t tp;
+    uint64_t steps;
+    uint64_t max_steps;
+    Tape* tape;
+    void* io;
+    void (*output)(void* io, Word value);
+    // Sets *failed instead of throwing, which the generated code could not
+    // unwind through; it then returns as if max_steps had been reached.
+    Word (*input)(void* io, Word current, bool* failed);
+    bool failed;
+};
+
+// Compiles ops to x86-64 machine code in an executable mapping. Step costs
+// are summed per basic block and max_steps is only checked at loop ends, so
+// a run may overshoot the budget by at most one loop iteration.
+class Jit {
+public:
+    // Whether this build can generate and run native code at all.
+    static bool supported();
+    // Whether supported() and every cell offset in code fits the displacement
+    // of an x86-64 operand; a Jit can only be built from such code.
+    static bool supports(const std::vector<Op>& code);
+
+    // The generated code adds the runs of the block that ends at code[i] to
+    // block_counts[i], see BrainfuckInterpreter::block_counts().
+    Jit(const std::vector<Op>& code, uint64_t* block_counts);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // Runs the program on ctx's tape. Returns false if max_steps was reached
+    // or input failed, which ctx->failed tells apart.
+    bool run(JitContext* ctx) const;
+    // Like run(), but for code that starts with a loop, starts at the first
+    // op of that loop's body, as if its test had just passed.
+    bool run_loop_body(JitContext* ctx) const;
+    size_t code_size() const { return size_; }
+
+private:
+    void* memory_ = nullptr;
+    size_t size_ = 0;
+    size_t mapped_size_ = 0;
+    size_t loop_body_entry_ = 0;
+};
+
+#endif  // JIT_HPP
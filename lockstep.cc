@@ -0,0 +1,308 @@
+#include "lockstep.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Multiplies like the cell type wraps, without the int promotion of 8- and
+// 16-bit cells overflowing.
+template <typename Cell>
+Cell multiply(Cell value, int32_t factor) {
+    return static_cast<Cell>(static_cast<uint64_t>(value) * static_cast<uint64_t>(static_cast<int64_t>(factor)));
+}
+
+// All ones if value is not zero, zero otherwise.
+template <typename Cell>
+Cell nonzero_mask(Cell value) {
+    return static_cast<Cell>(static_cast<Cell>(0) - static_cast<Cell>(value != 0));
+}
+
+int page_floor(int index, int page_size) {
+    int page = index / page_size;
+    if (index % page_size < 0) {
+        page--;
+    }
+    return page * page_size;
+}
+
+}  // namespace
+
+template <typename Cell>
+LockstepInterpreter<Cell>::LockstepInterpreter(std::vector<Op> code, std::vector<BufferedIo*> ios)
+    : code_(std::move(code)), ios_(std::move(ios)), lanes_(ios_.size()), cells_(kPageSize * kLanes, 0) {
+    if (ios_.size() > kLanes) {
+        throw std::invalid_argument("at most " + std::to_string(kLanes) + " lanes run in lockstep");
+    }
+    for (size_t lane = 0; lane < ios_.size(); lane++) {
+        alive_[lane] = static_cast<Cell>(~Cell(0));
+    }
+    running_ = ios_.size();
+}
+
+template <typename Cell>
+void LockstepInterpreter<Cell>::grow(int index) {
+    int end = origin_ + static_cast<int>(rows());
+    if (index >= end) {
+        cells_.resize(static_cast<size_t>(page_floor(index, kPageSize) + kPageSize - origin_) * kLanes, 0);
+        return;
+    }
+    // Like BasicTape, at least double when growing downwards.
+    int new_origin = std::min(page_floor(index, kPageSize), origin_ - static_cast<int>(rows()));
+    cells_.insert(cells_.begin(), static_cast<size_t>(origin_ - new_origin) * kLanes, 0);
+    origin_ = new_origin;
+}
+
+template <typename Cell>
+bool LockstepInterpreter<Cell>::any(const Cell* mask) const {
+    Cell result = 0;
+    for (size_t lane = 0; lane < kLanes; lane++) {
+        result |= mask[lane];
+    }
+    return result != 0;
+}
+
+template <typename Cell>
+void LockstepInterpreter<Cell>::fail(size_t lane, const std::string& error) {
+    lanes_[lane].state = LaneState::kFailed;
+    lanes_[lane].error = error;
+    active_[lane] = 0;
+    alive_[lane] = 0;
+    running_--;
+}
+
+template <typename Cell>
+void LockstepInterpreter<Cell>::diverge(size_t lane, size_t ip, int tp) {
+    lanes_[lane].state = LaneState::kDiverged;
+    lanes_[lane].ip = ip;
+    lanes_[lane].tp = tp;
+    active_[lane] = 0;
+    alive_[lane] = 0;
+    running_--;
+}
+
+template <typename Cell>
+void LockstepInterpreter<Cell>::flush_steps() {
+    size_t highest = 0;
+    for (size_t lane = 0; lane < kLanes; lane++) {
+        if (!active_[lane]) {
+            continue;
+        }
+        steps_[lane] += pending_steps_;
+        if (steps_[lane] >= max_steps_) {
+            fail(lane, "Maximum steps (" + std::to_string(max_steps_) + ") reached");
+        } else {
+            highest = std::max(highest, steps_[lane]);
+        }
+    }
+    pending_steps_ = 0;
+    headroom_ = max_steps_ - highest;
+}
+
+template <typename Cell>
+void LockstepInterpreter<Cell>::set_active(const Cell* mask) {
+    flush_steps();
+    for (size_t lane = 0; lane < kLanes; lane++) {
+        active_[lane] = mask[lane] & alive_[lane];
+    }
+}
+
+template <typename Cell>
+void LockstepInterpreter<Cell>::run(size_t max_steps) {
+    max_steps_ = max_steps;
+    std::copy(alive_, alive_ + kLanes, active_);
+    flush_steps();
+    size_t ip = 0;
+    while (running_ > 0) {
+        const Op& op = code_[ip++];
+        switch (op.code) {
+            case OpCode::kAdd: {
+                Cell* cells = row(tp_ + op.offset);
+                Cell arg = static_cast<Cell>(op.arg);
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    cells[lane] += arg & active_[lane];
+                }
+                break;
+            }
+            case OpCode::kMove: tp_ += op.arg; break;
+            case OpCode::kClear: {
+                Cell* cells = row(tp_ + op.offset);
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    steps_[lane] += static_cast<size_t>(op.iteration_cost) * (cells[lane] & active_[lane]);
+                    cells[lane] &= ~active_[lane];
+                }
+                // The lanes took different numbers of steps, so the next
+                // block end checks each of them against max_steps.
+                headroom_ = 0;
+                break;
+            }
+            case OpCode::kClearRange:
+                for (int i = 0; i < op.arg; i++) {
+                    Cell* cells = row(tp_ + op.offset + i);
+                    for (size_t lane = 0; lane < kLanes; lane++) {
+                        cells[lane] &= ~active_[lane];
+                    }
+                }
+                break;
+            case OpCode::kMulAdd: {
+                // Growing moves the rows, so grow before taking either.
+                row(tp_ + op.offset);
+                const Cell* source = row(tp_);
+                Cell* cells = row(tp_ + op.offset);
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    cells[lane] += multiply(source[lane], op.arg) & active_[lane];
+                }
+                break;
+            }
+            case OpCode::kScan: {
+                // Every lane scans its own cells; the first active lane's end
+                // becomes the shared tape pointer.
+                flush_steps();
+                int end = tp_;
+                bool has_end = false;
+                int rows_end = origin_ + static_cast<int>(rows());
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    if (!active_[lane]) {
+                        continue;
+                    }
+                    int index = tp_;
+                    while (index >= origin_ && index < rows_end && cells_[(index - origin_) * kLanes + lane] != 0) {
+                        index += op.arg;
+                    }
+                    steps_[lane] += static_cast<size_t>((index - tp_) / op.arg) * op.iteration_cost;
+                    if (!has_end) {
+                        has_end = true;
+                        end = index;
+                    } else if (index != end) {
+                        diverge(lane, ip, index);
+                    }
+                }
+                tp_ = end;
+                headroom_ = 0;
+                break;
+            }
+            case OpCode::kOutput: {
+                const Cell* cells = row(tp_);
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    if (active_[lane]) {
+                        ios_[lane]->write(static_cast<char>(cells[lane]));
+                    }
+                }
+                break;
+            }
+            case OpCode::kInput: {
+                Cell* cells = row(tp_);
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    if (!active_[lane]) {
+                        continue;
+                    }
+                    try {
+                        int c = ios_[lane]->read();
+                        if (c >= 0) {
+                            cells[lane] = static_cast<Cell>(c);
+                        }
+                    } catch (const std::runtime_error& e) {
+                        flush_steps();
+                        fail(lane, e.what());
+                    }
+                }
+                break;
+            }
+            case OpCode::kLoopStart: {
+                charge_block(op.cost);
+                const Cell* cells = row(tp_);
+                Cell entering[kLanes];
+                Cell any_entering = 0;
+                Cell any_skipping = 0;
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    entering[lane] = active_[lane] & nonzero_mask(cells[lane]);
+                    any_entering |= entering[lane];
+                    any_skipping |= active_[lane] & ~entering[lane];
+                }
+                if (any_entering == 0) {
+                    ip = op.arg;
+                    break;
+                }
+                frames_.emplace_back();
+                Frame& frame = frames_.back();
+                std::copy(active_, active_ + kLanes, frame.saved);
+                frame.has_exit = any_skipping != 0;
+                frame.exit_tp = tp_;
+                if (frame.has_exit) {
+                    set_active(entering);
+                }
+                break;
+            }
+            case OpCode::kLoopEnd:
+            case OpCode::kIfEnd: {
+                charge_block(op.cost);
+                Frame& frame = frames_.back();
+                Cell staying[kLanes] = {};
+                Cell any_staying = 0;
+                Cell any_leaving = 0;
+                // The body of a kIfEnd loop always leaves its cell zero.
+                if (op.code == OpCode::kLoopEnd) {
+                    const Cell* cells = row(tp_);
+                    for (size_t lane = 0; lane < kLanes; lane++) {
+                        staying[lane] = active_[lane] & nonzero_mask(cells[lane]);
+                        any_staying |= staying[lane];
+                        any_leaving |= active_[lane] & ~staying[lane];
+                    }
+                } else {
+                    any_leaving = any(active_);
+                }
+                if (any_leaving == 0 && any_staying != 0) {
+                    ip = op.arg;
+                    break;
+                }
+                flush_steps();
+                if (!frame.has_exit) {
+                    frame.has_exit = true;
+                    frame.exit_tp = tp_;
+                } else if (frame.exit_tp != tp_) {
+                    for (size_t lane = 0; lane < kLanes; lane++) {
+                        if (active_[lane] && !staying[lane]) {
+                            diverge(lane, ip, tp_);
+                        }
+                    }
+                }
+                if (any_staying != 0) {
+                    set_active(staying);
+                    ip = op.arg;
+                    break;
+                }
+                set_active(frame.saved);
+                tp_ = frame.exit_tp;
+                frames_.pop_back();
+                break;
+            }
+            case OpCode::kEnd:
+                charge_block(op.cost);
+                flush_steps();
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    if (active_[lane]) {
+                        lanes_[lane].state = LaneState::kFinished;
+                        alive_[lane] = 0;
+                        running_--;
+                    }
+                }
+                return;
+        }
+    }
+}
+
+template <typename Cell>
+void LockstepInterpreter<Cell>::hand_over(size_t lane, BrainfuckInterpreter<Cell>* interpreter) const {
+    BasicTape<Cell>& tape = interpreter->mutable_tape();
+    for (size_t i = 0; i < rows(); i++) {
+        Cell value = cells_[i * kLanes + lane];
+        if (value != 0) {
+            tape[origin_ + static_cast<int>(i)] = value;
+        }
+    }
+    interpreter->restore(lanes_[lane].ip, lanes_[lane].tp, steps_[lane]);
+}
+
+template class LockstepInterpreter<uint8_t>;
+template class LockstepInterpreter<uint16_t>;
+template class LockstepInterpreter<uint32_t>;
+template class LockstepInterpreter<uint64_t>;
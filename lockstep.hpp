@@ -0,0 +1,115 @@
+#ifndef LOCKSTEP_HPP
+#define LOCKSTEP_HPP
+
+#include "bytecode.hpp"
+#include "interpreter.hpp"
+#include "io.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Runs one program on up to kLanes inputs at once, one lane per input. The
+// lanes share the instruction and tape pointers and their tapes are
+// interleaved, so cell k of every lane is one contiguous row and each op
+// updates a whole row with a loop the compiler turns into vector ops. Lanes
+// that take a different branch at a loop op are masked off until the others
+// leave the loop too. A lane whose tape pointer would then differ from the
+// others', after an unbalanced loop or a scan, diverges: it stops, and
+// hand_over() continues it with a BrainfuckInterpreter. Cell is instantiated
+// for 8, 16, 32 and 64 bits in lockstep.cc.
+template <typename Cell>
+class LockstepInterpreter {
+public:
+    static constexpr size_t kLanes = 16;
+    static constexpr int kPageSize = 4096;  // in rows
+
+    enum class LaneState { kRunning, kFinished, kFailed, kDiverged };
+
+    // Lane i reads and writes through ios[i]. Throws std::invalid_argument
+    // for more than kLanes ios.
+    LockstepInterpreter(std::vector<Op> code, std::vector<BufferedIo*> ios);
+    // Runs until every lane has finished, failed or diverged.
+    void run(size_t max_steps);
+    size_t lanes() const { return ios_.size(); }
+    LaneState state(size_t lane) const { return lanes_[lane].state; }
+    // Why the lane failed, e.g. "Maximum steps (1000) reached".
+    const std::string& error(size_t lane) const { return lanes_[lane].error; }
+    size_t steps(size_t lane) const { return steps_[lane]; }
+    // Loads the state of a diverged lane into interpreter, which must run the
+    // same code on the lane's io, so that running it finishes the lane.
+    void hand_over(size_t lane, BrainfuckInterpreter<Cell>* interpreter) const;
+
+private:
+    struct Lane {
+        LaneState state = LaneState::kRunning;
+        std::string error;
+        // Where a diverged lane goes on.
+        size_t ip = 0;
+        int tp = 0;
+    };
+    // A loop the lanes of saved entered; the ones that left it wait with
+    // their tape pointer at exit_tp.
+    struct Frame {
+        Cell saved[kLanes];
+        bool has_exit;
+        int exit_tp;
+    };
+
+    // The kLanes cells at index, one per lane.
+    Cell* row(int index) {
+        size_t offset = static_cast<size_t>(index - origin_);
+        if (offset >= rows()) {
+            grow(index);
+            offset = static_cast<size_t>(index - origin_);
+        }
+        return cells_.data() + offset * kLanes;
+    }
+    size_t rows() const { return cells_.size() / kLanes; }
+    void grow(int index);
+    // Adds cost to the steps of the active lanes and fails the ones that
+    // run out.
+    void charge_block(size_t cost) {
+        pending_steps_ += cost;
+        if (pending_steps_ >= headroom_) {
+            flush_steps();
+        }
+    }
+    void flush_steps();
+    // Makes the lanes of mask that are alive the active ones.
+    void set_active(const Cell* mask);
+    // Stops lane, which goes on at ip with the tape pointer at tp.
+    void diverge(size_t lane, size_t ip, int tp);
+    void fail(size_t lane, const std::string& error);
+    bool any(const Cell* mask) const;
+
+    std::vector<Op> code_;
+    std::vector<BufferedIo*> ios_;
+    std::vector<Lane> lanes_;
+    size_t max_steps_ = 0;
+    size_t steps_[kLanes] = {};
+    // Steps every active lane took since flush_steps() added them to steps_,
+    // so that block ends only add to one counter while the same lanes run.
+    size_t pending_steps_ = 0;
+    // How many steps the active lane with the most may still take.
+    size_t headroom_ = 0;
+    // All ones for the lanes that run the current op, zero for the others,
+    // so that ops apply them with an and instead of a branch.
+    Cell active_[kLanes] = {};
+    // The lanes that have neither finished, failed nor diverged.
+    Cell alive_[kLanes] = {};
+    size_t running_ = 0;
+    std::vector<Frame> frames_;
+    // Row origin_ + i holds cells_[i * kLanes, (i + 1) * kLanes); origin_ is
+    // always a multiple of kPageSize.
+    std::vector<Cell> cells_;
+    int origin_ = 0;
+    int tp_ = 0;
+};
+
+extern template class LockstepInterpreter<uint8_t>;
+extern template class LockstepInterpreter<uint16_t>;
+extern template class LockstepInterpreter<uint32_t>;
+extern template class LockstepInterpreter<uint64_t>;
+
+#endif  // LOCKSTEP_HPP
@@ -0,0 +1,60 @@
+#include "loop_detector.hpp"
+#include <algorithm>
+
+namespace {
+constexpr int kMarksPageSize = 4096;
+
+int page_floor(int index) {
+    int page = index / kMarksPageSize;
+    if (index % kMarksPageSize < 0) {
+        page--;
+    }
+    return page * kMarksPageSize;
+}
+}  // namespace
+
+LoopDetector::LoopDetector(std::string_view source, const std::vector<size_t>& instruction_offsets,
+                           const std::vector<Op>& code, const DebugInfo& debug_info) {
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        size_t position = ip < debug_info.positions.size() ? debug_info.positions[ip] : instruction_offsets.size();
+        op_offsets_.push_back(position < instruction_offsets.size() ? instruction_offsets[position] : source.size());
+    }
+    line_starts_.push_back(0);
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] == '\n') {
+            line_starts_.push_back(i + 1);
+        }
+    }
+}
+
+std::string LoopDetector::location(size_t ip) const {
+    size_t offset = op_offsets_[ip];
+    size_t line = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset) - line_starts_.begin() - 1;
+    return "line " + std::to_string(line + 1) + ", column " + std::to_string(offset - line_starts_[line] + 1);
+}
+
+void LoopDetector::save(size_t ip, int tp) {
+    saved_ = true;
+    saved_ip_ = ip;
+    saved_tp_ = tp;
+    back_edges_ = 0;
+    dirty_.clear();
+    if (++epoch_ == 0) {
+        // Marks of 4 billion saves ago would look current again.
+        std::fill(marks_.begin(), marks_.end(), 0);
+        epoch_ = 1;
+    }
+}
+
+void LoopDetector::grow_marks(int index) {
+    if (marks_.empty()) {
+        marks_origin_ = page_floor(index);
+        marks_.resize(kMarksPageSize, 0);
+    } else if (index >= marks_origin_ + static_cast<int>(marks_.size())) {
+        marks_.resize(static_cast<size_t>(page_floor(index) + kMarksPageSize - marks_origin_), 0);
+    } else {
+        int new_origin = std::min(page_floor(index), marks_origin_ - static_cast<int>(marks_.size()));
+        marks_.insert(marks_.begin(), static_cast<size_t>(marks_origin_ - new_origin), 0);
+        marks_origin_ = new_origin;
+    }
+}
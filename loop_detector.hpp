@@ -0,0 +1,107 @@
+#ifndef LOOP_DETECTOR_HPP
+#define LOOP_DETECTOR_HPP
+
+#include "bytecode.hpp"
+#include "tape.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Proves that a run never ends by catching it in the same state twice: if a
+// loop jumps back with the same tape pointer and the same tape as the last
+// time the state was saved, and no input was read in between, the run
+// repeats that stretch forever. The state is saved at loop back-edges at
+// doubling intervals, as in Brent's cycle detection, so cycles of any length
+// are found. Instead of copying the tape, the detector keeps the old value
+// of every cell written since the save; the cells nobody wrote are equal by
+// definition. Cycles that write more than kMaxDirtyCells cells are not
+// found.
+class LoopDetector {
+public:
+    static constexpr size_t kMaxDirtyCells = 4096;
+
+    // instruction_offsets maps every instruction of the compiled code to its
+    // offset in source, see filter_source().
+    LoopDetector(std::string_view source, const std::vector<size_t>& instruction_offsets,
+                 const std::vector<Op>& code, const DebugInfo& debug_info);
+
+    // Called before an op writes the cell at index, which holds value.
+    void write(int index, uint64_t value) {
+        if (!saved_) {
+            return;
+        }
+        size_t slot = static_cast<size_t>(index - marks_origin_);
+        if (slot >= marks_.size()) {
+            grow_marks(index);
+            slot = static_cast<size_t>(index - marks_origin_);
+        }
+        if (marks_[slot] != epoch_) {
+            marks_[slot] = epoch_;
+            dirty_.push_back(DirtyCell{index, value});
+            if (dirty_.size() > kMaxDirtyCells) {
+                saved_ = false;
+            }
+        }
+    }
+    // Called before ',' consumes input, which makes the saved state useless.
+    void input() { saved_ = false; }
+    // Forgets the saved state, for when writes were not reported for a
+    // while, and starts over with short intervals.
+    void reset() {
+        saved_ = false;
+        interval_ = 1;
+    }
+    // Called when the loop that ends at code[ip] jumps back with the tape
+    // pointer at tp. Returns true if the run is in the saved state again.
+    template <typename Cell>
+    bool back_edge(size_t ip, int tp, BasicTape<Cell>& tape) {
+        if (saved_ && ip == saved_ip_ && tp == saved_tp_) {
+            bool same = true;
+            for (const DirtyCell& cell : dirty_) {
+                if (tape[cell.index] != cell.value) {
+                    same = false;
+                    break;
+                }
+            }
+            if (same) {
+                return true;
+            }
+        }
+        if (!saved_ || ++back_edges_ == interval_) {
+            if (saved_) {
+                interval_ *= 2;
+            }
+            save(ip, tp);
+        }
+        return false;
+    }
+    // "line L, column C" of the source instruction code[ip] came from.
+    std::string location(size_t ip) const;
+
+private:
+    struct DirtyCell {
+        int index;
+        uint64_t value;
+    };
+
+    void save(size_t ip, int tp);
+    void grow_marks(int index);
+
+    std::vector<size_t> op_offsets_;
+    std::vector<size_t> line_starts_;
+    bool saved_ = false;
+    size_t saved_ip_ = 0;
+    int saved_tp_ = 0;
+    uint64_t back_edges_ = 0;
+    uint64_t interval_ = 1;
+    std::vector<DirtyCell> dirty_;
+    // marks_[index - marks_origin_] == epoch_ if the cell is in dirty_; the
+    // epoch changes on every save, so saving does not clear the marks.
+    std::vector<uint32_t> marks_;
+    int marks_origin_ = 0;
+    uint32_t epoch_ = 0;
+};
+
+#endif  // LOOP_DETECTOR_HPP
@@ -0,0 +1,97 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+std::string json_string(const std::string& value) {
+    std::string result = "\"";
+    for (char c : value) {
+        switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[7];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    result += escaped;
+                } else {
+                    result += c;
+                }
+        }
+    }
+    return result + "\"";
+}
+
+}  // namespace
+
+void RunMetrics::set_ops(const std::vector<Op>& code, const std::vector<uint64_t>& block_counts) {
+    std::fill(ops, ops + kOpCodeCount, 0);
+    max_loop_nesting = 0;
+    // A block is the ops after one loop op or kEnd up to and including the
+    // next, and all of them ran as often as that next one was reached. A
+    // block that ran at all proves that the run entered every loop around it.
+    size_t block_start = 0;
+    size_t nesting = 0;
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        OpCode op = code[ip].code;
+        if (op != OpCode::kLoopStart && op != OpCode::kLoopEnd && op != OpCode::kIfEnd && op != OpCode::kEnd) {
+            continue;
+        }
+        if (block_counts[ip] > 0) {
+            for (size_t i = block_start; i <= ip; i++) {
+                ops[static_cast<size_t>(code[i].code)] += block_counts[ip];
+            }
+            max_loop_nesting = std::max(max_loop_nesting, nesting);
+        }
+        if (op == OpCode::kLoopStart) {
+            nesting++;
+        } else if (op != OpCode::kEnd) {
+            nesting--;
+        }
+        block_start = ip + 1;
+    }
+}
+
+void RunMetrics::write(const std::string& path) const {
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"program\": " << json_string(program) << ",\n";
+    out << "  \"engine\": " << json_string(engine) << ",\n";
+    out << "  \"cell_bits\": " << cell_bits << ",\n";
+    out << "  \"error\": " << (error.empty() ? "null" : json_string(error)) << ",\n";
+    out << "  \"steps\": " << steps << ",\n";
+    out << "  \"seconds\": " << std::fixed << std::setprecision(6) << seconds << ",\n";
+    out << "  \"steps_per_second\": " << std::setprecision(0)
+        << (seconds > 0 ? static_cast<double>(steps) / seconds : 0) << ",\n";
+    out << "  \"peak_tape\": {\"begin\": " << peak_begin << ", \"end\": " << peak_end
+        << ", \"cells\": " << peak_end - peak_begin << "},\n";
+    out << "  \"final_tape\": {\"begin\": " << final_begin << ", \"end\": " << final_end
+        << ", \"pointer\": " << tape_pointer << "},\n";
+    out << "  \"input_bytes\": " << input_bytes << ",\n";
+    out << "  \"output_bytes\": " << output_bytes << ",\n";
+    out << "  \"max_loop_nesting\": " << max_loop_nesting << ",\n";
+    out << "  \"ops\": {";
+    for (size_t i = 0; i < kOpCodeCount; i++) {
+        out << (i == 0 ? "" : ", ") << json_string(opcode_name(static_cast<OpCode>(i))) << ": " << ops[i];
+    }
+    out << "}\n}\n";
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary);
+        file << out.str();
+        if (!file.flush()) {
+            throw std::runtime_error("could not write metrics to " + path);
+        }
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("could not replace metrics " + path);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "bytecode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What one run did, for bfi --metrics. All of it is read off the interpreter,
+// the tape and the io once the run is over. The op mix and the loop nesting
+// come from the interpreter's block counts, which every engine keeps at one
+// increment per block, so collecting them is cheap enough to leave on. A
+// resumed run only counts what it ran since the checkpoint.
+struct RunMetrics {
+    std::string program;
+    std::string engine;
+    int cell_bits = 32;
+    // Why the run stopped early, e.g. "Maximum steps (1000) reached"; empty
+    // if it finished.
+    std::string error;
+    size_t steps = 0;
+    double seconds = 0;
+    // Cells [peak_begin, peak_end) were backed by memory; the tape never
+    // shrinks, so that is the most the run used.
+    int peak_begin = 0;
+    int peak_end = 0;
+    // Cells [final_begin, final_end) are the span of the nonzero cells at the
+    // end, empty if there are none.
+    int final_begin = 0;
+    int final_end = 0;
+    int tape_pointer = 0;
+    size_t input_bytes = 0;
+    size_t output_bytes = 0;
+    // Deepest nesting of loops whose body the run entered.
+    size_t max_loop_nesting = 0;
+    // How many ops of every OpCode ran.
+    uint64_t ops[kOpCodeCount] = {};
+
+    // Fills in max_loop_nesting and ops from code and how often each of its
+    // blocks ran, see BrainfuckInterpreter::block_counts().
+    void set_ops(const std::vector<Op>& code, const std::vector<uint64_t>& block_counts);
+    // Writes the metrics to path as one JSON object, replacing the file
+    // only once it is complete. Throws std::runtime_error.
+    void write(const std::string& path) const;
+};
+
+#endif  // METRICS_HPP
@@ -0,0 +1,156 @@
+#include "profile.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <unordered_map>
+
+namespace {
+constexpr char kInstructions[] = ".,+-<>[]";
+constexpr size_t kMaxLabelLength = 60;
+
+std::string_view trim(std::string_view s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+std::string shorten(const std::string& label) {
+    if (label.size() <= kMaxLabelLength) {
+        return label;
+    }
+    return label.substr(0, kMaxLabelLength - 3) + "...";
+}
+}  // namespace
+
+Profile::Profile(std::string_view source, const std::vector<size_t>& instruction_offsets,
+                 const std::vector<Op>& code, const DebugInfo& debug_info)
+    : code_(code), costs_(debug_info.costs), executions_(code.size()), dynamic_steps_(code.size()),
+      iterations_(code.size()) {
+    std::vector<int> line_contexts;
+    std::vector<size_t> line_starts;
+    parse_contexts(source, &line_contexts, &line_starts);
+    for (size_t position : debug_info.positions) {
+        size_t offset = position < instruction_offsets.size() ? instruction_offsets[position] : source.size();
+        size_t line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin() - 1;
+        op_contexts_.push_back(line_contexts[line]);
+    }
+}
+
+void Profile::parse_contexts(std::string_view source, std::vector<int>* line_contexts, std::vector<size_t>* line_starts) {
+    contexts_.push_back(Context{"<top level>", -1, 0});
+    struct Scope {
+        int indent;
+        int context;
+    };
+    std::vector<Scope> scopes = {{-1, 0}};
+    size_t start = 0;
+    while (start <= source.size()) {
+        size_t end = source.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = source.size();
+        }
+        std::string_view line = source.substr(start, end - start);
+        line_starts->push_back(start);
+        std::string_view text = trim(line);
+        int indent = text.empty() ? 0 : static_cast<int>(line.find_first_not_of(' '));
+        size_t first_instruction = text.find_first_of(kInstructions);
+        std::string_view prefix = trim(text.substr(0, first_instruction));
+        // Variable names like "__t{7}" label the cells that code lines touch;
+        // anything with spaces is a comment that scopes the code after it.
+        bool is_comment = !text.empty() &&
+            (first_instruction == std::string_view::npos || prefix.find_first_of(" :(") != std::string_view::npos);
+        if (is_comment) {
+            while (scopes.back().indent >= indent) {
+                scopes.pop_back();
+            }
+            std::string label(first_instruction == std::string_view::npos ? text : prefix);
+            contexts_.push_back(Context{label, scopes.back().context, line_starts->size()});
+            scopes.push_back(Scope{indent, static_cast<int>(contexts_.size()) - 1});
+        } else if (!text.empty()) {
+            while (scopes.back().indent > indent) {
+                scopes.pop_back();
+            }
+        }
+        line_contexts->push_back(scopes.back().context);
+        start = end + 1;
+    }
+}
+
+void Profile::record(size_t ip, uint64_t dynamic_steps, size_t next_ip) {
+    const Op& op = code_[ip];
+    executions_[ip]++;
+    dynamic_steps_[ip] += dynamic_steps;
+    if (op.code == OpCode::kLoopStart && next_ip == ip + 1) {
+        iterations_[ip]++;
+    } else if (op.code == OpCode::kLoopEnd && next_ip == static_cast<size_t>(op.arg)) {
+        iterations_[op.arg - 1]++;
+    } else if (op.iteration_cost != 0) {
+        iterations_[ip] += dynamic_steps / op.iteration_cost;
+    }
+}
+
+int Profile::function_of(int context) const {
+    int outermost = context;
+    for (int c = context; c > 0; c = contexts_[c].parent) {
+        if (contexts_[c].label.rfind("define ", 0) == 0) {
+            return c;
+        }
+        outermost = c;
+    }
+    return outermost;
+}
+
+void Profile::print(std::ostream& out, size_t max_entries) const {
+    std::vector<uint64_t> steps(contexts_.size());
+    std::vector<uint64_t> iterations(contexts_.size());
+    uint64_t total = 0;
+    for (size_t ip = 0; ip < code_.size(); ip++) {
+        uint64_t op_steps = executions_[ip] * costs_[ip] + dynamic_steps_[ip];
+        steps[op_contexts_[ip]] += op_steps;
+        iterations[op_contexts_[ip]] += iterations_[ip];
+        total += op_steps;
+    }
+    auto percent = [total](uint64_t value) {
+        return total == 0 ? 0.0 : 100.0 * value / total;
+    };
+
+    std::vector<int> order;
+    for (size_t c = 0; c < contexts_.size(); c++) {
+        if (steps[c] > 0) {
+            order.push_back(c);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&steps](int a, int b) { return steps[a] > steps[b]; });
+    out << "profile: " << total << " steps" << std::endl;
+    out << std::setw(14) << "steps" << std::setw(8) << "%" << std::setw(14) << "iterations" << std::setw(8) << "line"
+        << "  location" << std::endl;
+    out << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < order.size() && i < max_entries; i++) {
+        int c = order[i];
+        out << std::setw(14) << steps[c] << std::setw(7) << percent(steps[c]) << "%" << std::setw(14) << iterations[c]
+            << std::setw(8) << contexts_[c].line << "  " << shorten(contexts_[c].label);
+        int function = function_of(c);
+        if (function != c && function != 0) {
+            out << "  inside " << shorten(contexts_[function].label);
+        }
+        out << std::endl;
+    }
+
+    std::unordered_map<int, uint64_t> function_steps;
+    for (size_t c = 0; c < contexts_.size(); c++) {
+        function_steps[function_of(c)] += steps[c];
+    }
+    std::vector<std::pair<int, uint64_t>> functions(function_steps.begin(), function_steps.end());
+    std::sort(functions.begin(), functions.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    out << "steps by function:" << std::endl;
+    for (size_t i = 0; i < functions.size() && i < max_entries; i++) {
+        if (functions[i].second == 0) {
+            break;
+        }
+        out << std::setw(14) << functions[i].second << std::setw(7) << percent(functions[i].second) << "%  "
+            << shorten(contexts_[functions[i].first].label) << std::endl;
+    }
+    out << std::defaultfloat;
+}
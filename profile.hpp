@@ -0,0 +1,48 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include "bytecode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Attributes the steps of a run to the comments bfs writes into its output,
+// like "div(x{3}; __t{9})" or "define fun nprint(x)". bfs indents nested
+// constructs, so a comment line covers the lines after it up to the next
+// comment that is not indented deeper.
+class Profile {
+public:
+    // instruction_offsets maps every instruction of the compiled code to its
+    // offset in source, see filter_source().
+    Profile(std::string_view source, const std::vector<size_t>& instruction_offsets,
+            const std::vector<Op>& code, const DebugInfo& debug_info);
+
+    // Records one execution of code[ip] that added dynamic_steps on top of
+    // its static cost and continued at next_ip.
+    void record(size_t ip, uint64_t dynamic_steps, size_t next_ip);
+    // Prints the comments that used most steps and the totals per function.
+    void print(std::ostream& out, size_t max_entries = 20) const;
+
+private:
+    struct Context {
+        std::string label;
+        int parent;
+        size_t line;
+    };
+    void parse_contexts(std::string_view source, std::vector<int>* line_contexts, std::vector<size_t>* line_starts);
+    // The enclosing "define fun ..." comment, or the outermost comment.
+    int function_of(int context) const;
+
+    const std::vector<Op>& code_;
+    std::vector<uint32_t> costs_;
+    std::vector<Context> contexts_;
+    std::vector<int> op_contexts_;
+    std::vector<uint64_t> executions_;
+    std::vector<uint64_t> dynamic_steps_;
+    std::vector<uint64_t> iterations_;
+};
+
+#endif  // PROFILE_HPP
@@ -0,0 +1,103 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <utility>
+
+Scheduler::Scheduler(size_t threads, size_t slice_steps) : slice_steps_(slice_steps) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    // Only start once every queue exists, since workers steal from all.
+    for (size_t i = 0; i < threads; i++) {
+        workers_[i]->thread = std::thread(&Scheduler::work, this, i);
+    }
+}
+
+Scheduler::~Scheduler() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+void Scheduler::submit(std::unique_ptr<Instance> instance, DoneFunction done) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_++;
+    }
+    Worker* worker = workers_[next_worker_++ % workers_.size()].get();
+    push(worker, Task{std::move(instance), std::move(done)});
+}
+
+void Scheduler::wait() {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    all_done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void Scheduler::push(Worker* worker, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.push_back(std::move(task));
+    }
+    queued_++;
+    // A worker going to sleep counts itself before it checks queued_, so
+    // either it sees this task or this sees it.
+    if (sleeping_ > 0) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        work_available_.notify_one();
+    }
+}
+
+bool Scheduler::take(size_t index, Task* task) {
+    while (true) {
+        // The own queue round robin from the front, the others' from the
+        // back, which is what their owners would run last.
+        for (size_t i = 0; i < workers_.size(); i++) {
+            Worker* worker = workers_[(index + i) % workers_.size()].get();
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            if (worker->tasks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                *task = std::move(worker->tasks.front());
+                worker->tasks.pop_front();
+            } else {
+                *task = std::move(worker->tasks.back());
+                worker->tasks.pop_back();
+            }
+            queued_--;
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        sleeping_++;
+        work_available_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+        sleeping_--;
+        if (stopping_) {
+            return false;
+        }
+    }
+}
+
+void Scheduler::work(size_t index) {
+    Worker* own = workers_[index].get();
+    Task task;
+    while (take(index, &task)) {
+        if (task.instance->run_for(slice_steps_) == Instance::State::kRunning) {
+            push(own, std::move(task));
+            continue;
+        }
+        task.done(std::move(task.instance));
+        task = Task();
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        if (--pending_ == 0) {
+            all_done_.notify_all();
+        }
+    }
+}
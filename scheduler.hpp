@@ -0,0 +1,74 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "instance.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Time-slices many Instances across a pool of threads. A worker runs one
+// slice of an instance at a time and queues it again behind the others if it
+// has not ended, so long programs cannot hold a thread while short ones wait.
+// Every worker has its own queue and steals from the back of the others'
+// when it runs dry.
+class Scheduler {
+public:
+    static constexpr size_t kDefaultSliceSteps = 1 << 20;
+
+    // Called on a worker thread once instance has finished or failed.
+    using DoneFunction = std::function<void(std::unique_ptr<Instance> instance)>;
+
+    // threads == 0 starts one thread per core. The callbacks of the
+    // instances run on these threads.
+    explicit Scheduler(size_t threads = 0, size_t slice_steps = kDefaultSliceSteps);
+    // Waits for all instances, like wait().
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Queues instance to run until it ends. Can also be called from the
+    // callbacks.
+    void submit(std::unique_ptr<Instance> instance, DoneFunction done);
+    // Blocks until every submitted instance has ended.
+    void wait();
+    size_t threads() const { return workers_.size(); }
+
+private:
+    struct Task {
+        std::unique_ptr<Instance> instance;
+        DoneFunction done;
+    };
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void push(Worker* worker, Task task);
+    // Takes the next task for workers_[index], sleeping while there is none.
+    // Returns false once the scheduler shuts down.
+    bool take(size_t index, Task* task);
+    void work(size_t index);
+
+    size_t slice_steps_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_worker_{0};
+    // Tasks in all queues, and workers waiting for one.
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> sleeping_{0};
+    std::mutex idle_mutex_;
+    std::condition_variable work_available_;
+    bool stopping_ = false;
+    // Submitted instances that have not ended yet.
+    std::mutex pending_mutex_;
+    std::condition_variable all_done_;
+    size_t pending_ = 0;
+};
+
+#endif  // SCHEDULER_HPP
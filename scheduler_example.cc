@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "instance.hpp"
+#include "scheduler.hpp"
+
+// Runs many embedded programs through a Scheduler, in small slices and with
+// every cell width and engine, and checks what each of them wrote. Exits with
+// 1 if one of them went wrong.
+
+const size_t kInstances = 64;
+const size_t kThreads = 4;
+const size_t kSliceSteps = 1000;
+// Copies its input to its output.
+const char kEcho[] = ",[.,]";
+// Never ends, so it must fail once it reaches max_steps.
+const char kEndless[] = "+[]";
+const size_t kEndlessMaxSteps = 10000;
+const int kCellBits[] = {8, 16, 32, 64};
+const Engine kEngines[] = {Engine::kSwitch, Engine::kThreaded, Engine::kJit, Engine::kTiered};
+
+// One instance's input and what it did with it.
+struct ExampleRun {
+    bool endless = false;
+    std::string input;
+    size_t input_pos = 0;
+    std::string output;
+    Instance::State state = Instance::State::kRunning;
+    std::string error;
+};
+
+int main() {
+    std::vector<std::unique_ptr<ExampleRun>> runs;
+    {
+        Scheduler scheduler(kThreads, kSliceSteps);
+        for (size_t i = 0; i < kInstances; i++) {
+            auto run = std::make_unique<ExampleRun>();
+            run->endless = i % 8 == 7;
+            // Long enough to take several slices.
+            run->input = "instance " + std::to_string(i) + ": " + std::string(50 * i, static_cast<char>('a' + i % 26));
+            InstanceOptions options;
+            options.cell_bits = kCellBits[i % 4];
+            options.engine = kEngines[i / 4 % 4];
+            options.eof = EofBehavior::kZero;
+            if (run->endless) {
+                options.max_steps = kEndlessMaxSteps;
+            }
+            ExampleRun* r = run.get();
+            auto instance = std::make_unique<Instance>(
+                run->endless ? kEndless : kEcho, options,
+                [r](char* data, size_t size) -> size_t {
+                    size_t n = std::min(size, r->input.size() - r->input_pos);
+                    std::memcpy(data, r->input.data() + r->input_pos, n);
+                    r->input_pos += n;
+                    return n;
+                },
+                [r](const char* data, size_t size) { r->output.append(data, size); });
+            scheduler.submit(std::move(instance), [r](std::unique_ptr<Instance> instance) {
+                r->state = instance->state();
+                r->error = instance->error();
+            });
+            runs.push_back(std::move(run));
+        }
+        scheduler.wait();
+    }
+
+    size_t failed = 0;
+    std::string endless_error = "Maximum steps (" + std::to_string(kEndlessMaxSteps) + ") reached";
+    for (size_t i = 0; i < runs.size(); i++) {
+        const ExampleRun& run = *runs[i];
+        bool ok = run.endless
+                      ? run.state == Instance::State::kFailed && run.error == endless_error && run.output.empty()
+                      : run.state == Instance::State::kFinished && run.output == run.input;
+        if (!ok) {
+            std::cerr << "Error: instance " << i << " ended with \"" << run.error << "\" after writing \""
+                      << run.output << "\"" << std::endl;
+            failed++;
+        }
+    }
+    std::cout << runs.size() - failed << " of " << runs.size() << " instances on " << kThreads
+              << " threads did what they should" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include "source.hpp"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceFile::SourceFile(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    is_open_ = true;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+            mapping_ = mapping;
+            data_ = static_cast<const char*>(mapping);
+            size_ = st.st_size;
+            close(fd);
+            return;
+        }
+    }
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            is_open_ = false;
+            break;
+        }
+        buffer_.append(chunk, n);
+    }
+    close(fd);
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+SourceFile::~SourceFile() {
+    if (mapping_ != nullptr) {
+        munmap(mapping_, size_);
+    }
+}
+
+namespace {
+constexpr std::array<bool, 256> make_instruction_table() {
+    std::array<bool, 256> table{};
+    for (char c : {'.', ',', '+', '-', '<', '>', '[', ']'}) {
+        table[static_cast<unsigned char>(c)] = true;
+    }
+    return table;
+}
+constexpr std::array<bool, 256> kIsInstruction = make_instruction_table();
+}  // namespace
+
+std::string filter_source(std::string_view source, bool strip_comments, std::vector<size_t>* positions) {
+    std::string code;
+    const char* p = source.data();
+    const char* end = p + source.size();
+    while (p < end) {
+        // Copy up to the next comment; memchr finds it much faster than
+        // looking at every byte in the loop below.
+        const char* stop = strip_comments ? static_cast<const char*>(memchr(p, '#', end - p)) : nullptr;
+        if (stop == nullptr) {
+            stop = end;
+        }
+        for (; p < stop; p++) {
+            if (kIsInstruction[static_cast<unsigned char>(*p)]) {
+                code.push_back(*p);
+                if (positions != nullptr) {
+                    positions->push_back(p - source.data());
+                }
+            }
+        }
+        if (p < end) {
+            const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+            p = newline == nullptr ? end : newline + 1;
+        }
+    }
+    return code;
+}
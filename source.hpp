@@ -0,0 +1,35 @@
+#ifndef SOURCE_HPP
+#define SOURCE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only contents of a file. Regular files are mmap'd so that loading
+// does not copy them; pipes and other unmappable files are read instead.
+class SourceFile {
+public:
+    explicit SourceFile(const std::string& filename);
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    bool is_open() const { return is_open_; }
+    std::string_view contents() const { return std::string_view(data_, size_); }
+
+private:
+    bool is_open_ = false;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    void* mapping_ = nullptr;
+    std::string buffer_;
+};
+
+// Returns only the brainfuck instructions in source in one pass. With
+// strip_comments, everything from '#' to the end of the line is skipped.
+// If positions is given, it receives the offset in source of every returned
+// instruction.
+std::string filter_source(std::string_view source, bool strip_comments, std::vector<size_t>* positions = nullptr);
+
+#endif  // SOURCE_HPP
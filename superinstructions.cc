@@ -0,0 +1,97 @@
+#include "superinstructions.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <numeric>
+
+namespace {
+constexpr size_t kMaxSequenceLength = 4;
+
+bool ends_block(OpCode code) {
+    return code == OpCode::kLoopStart || code == OpCode::kLoopEnd || code == OpCode::kIfEnd || code == OpCode::kEnd;
+}
+
+bool is_straight(OpCode code) {
+    return code == OpCode::kAdd || code == OpCode::kMove || code == OpCode::kClear || code == OpCode::kMulAdd;
+}
+}  // namespace
+
+bool SuperinstructionPlan::can_fuse(OpCode first, OpCode second) {
+    return is_straight(first) && (is_straight(second) || second == OpCode::kLoopStart || second == OpCode::kLoopEnd);
+}
+
+SuperinstructionPlan::SuperinstructionPlan(const std::vector<Op>& code, const std::vector<uint64_t>& executions)
+    : fused_(code.size()), warmup_ops_(std::accumulate(executions.begin(), executions.end(), uint64_t{0})) {
+    // Jumps only land right after loop ops, so all ops of a basic block run
+    // equally often and a sequence inside one runs as often as its first op.
+    std::map<std::vector<OpCode>, Sequence> sequences;
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        std::vector<OpCode> codes = {code[ip].code};
+        for (size_t next = ip + 1; next < code.size() && codes.size() < kMaxSequenceLength; next++) {
+            if (ends_block(code[next - 1].code)) {
+                break;
+            }
+            codes.push_back(code[next].code);
+            Sequence& sequence = sequences[codes];
+            sequence.codes = codes;
+            sequence.executions += executions[ip];
+            sequence.sites++;
+        }
+    }
+
+    std::vector<size_t> candidates;
+    for (size_t ip = 0; ip + 1 < code.size(); ip++) {
+        if (executions[ip] > 0 && can_fuse(code[ip].code, code[ip + 1].code)) {
+            candidates.push_back(ip);
+        }
+    }
+    auto pair_executions = [&](size_t ip) { return sequences[{code[ip].code, code[ip + 1].code}].executions; };
+    // Hottest sites first; among equally hot ones, the more common pair.
+    std::stable_sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+        if (executions[a] != executions[b]) {
+            return executions[a] > executions[b];
+        }
+        return pair_executions(a) > pair_executions(b);
+    });
+    std::vector<bool> taken(code.size());
+    for (size_t ip : candidates) {
+        if (!taken[ip] && !taken[ip + 1]) {
+            taken[ip] = taken[ip + 1] = true;
+            fused_[ip] = true;
+            sequences[{code[ip].code, code[ip + 1].code}].fused_sites++;
+        }
+    }
+
+    for (auto& [codes, sequence] : sequences) {
+        if (sequence.executions > 0) {
+            sequences_.push_back(std::move(sequence));
+        }
+    }
+    std::stable_sort(sequences_.begin(), sequences_.end(),
+                     [](const Sequence& a, const Sequence& b) { return a.executions > b.executions; });
+}
+
+void SuperinstructionPlan::print(std::ostream& out, size_t max_entries) const {
+    auto percent = [this](uint64_t value) { return warmup_ops_ == 0 ? 0.0 : 100.0 * value / warmup_ops_; };
+    out << "superinstructions: warm-up ran " << warmup_ops_ << " ops" << std::endl;
+    out << std::fixed << std::setprecision(1);
+    for (size_t length = 2; length <= kMaxSequenceLength; length++) {
+        size_t printed = 0;
+        for (const Sequence& sequence : sequences_) {
+            if (sequence.codes.size() != length) {
+                continue;
+            }
+            if (printed++ == max_entries) {
+                break;
+            }
+            out << std::setw(14) << sequence.executions << std::setw(7) << percent(sequence.executions) << "%  ";
+            for (size_t i = 0; i < sequence.codes.size(); i++) {
+                out << (i == 0 ? "" : " ") << opcode_name(sequence.codes[i]);
+            }
+            if (sequence.fused_sites > 0) {
+                out << "  (fused at " << sequence.fused_sites << " of " << sequence.sites << " sites)";
+            }
+            out << std::endl;
+        }
+    }
+}
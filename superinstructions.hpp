@@ -0,0 +1,44 @@
+#ifndef SUPERINSTRUCTIONS_HPP
+#define SUPERINSTRUCTIONS_HPP
+
+#include "bytecode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Picks the adjacent pairs of ops that the threaded engine runs as one
+// superinstruction, from how often each op ran during a warm-up. Each op is
+// in at most one pair, so of overlapping candidates like "move add move" the
+// hotter pair wins. The warm-up also yields the frequency of every short op
+// sequence, which shows the bfs lowering patterns a program spends its time
+// in.
+class SuperinstructionPlan {
+public:
+    SuperinstructionPlan() = default;
+    // executions[ip] is how often code[ip] ran during the warm-up.
+    SuperinstructionPlan(const std::vector<Op>& code, const std::vector<uint64_t>& executions);
+
+    // Pairs whose first op is add, move, clear or mul_add and whose second op
+    // is one of those or a loop op.
+    static bool can_fuse(OpCode first, OpCode second);
+    // True if code[ip] and code[ip + 1] run as one superinstruction.
+    bool fused(size_t ip) const { return ip < fused_.size() && fused_[ip]; }
+    // Prints the most frequent op sequences of length 2 to 4 and the fused
+    // pairs.
+    void print(std::ostream& out, size_t max_entries = 10) const;
+
+private:
+    struct Sequence {
+        std::vector<OpCode> codes;
+        uint64_t executions;
+        size_t sites = 0;        // places in the code it occurs at
+        size_t fused_sites = 0;  // for pairs, how many of them were fused
+    };
+
+    std::vector<bool> fused_;
+    std::vector<Sequence> sequences_;
+    uint64_t warmup_ops_ = 0;
+};
+
+#endif  // SUPERINSTRUCTIONS_HPP
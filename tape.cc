@@ -0,0 +1,105 @@
+#include "tape.hpp"
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+int page_floor(int index) {
+    int page = index / Tape::kPageSize;
+    if (index % Tape::kPageSize < 0) {
+        page--;
+    }
+    return page * Tape::kPageSize;
+}
+
+#ifdef __SSE2__
+// Byte mask of the lanes 0, stride, 2 * stride, ... of a vector of cells
+// cell_size bytes wide, as returned by _mm_movemask_epi8.
+int lane_mask(int stride, int cell_size) {
+    int mask = 0;
+    for (int lane = 0; lane < 16 / cell_size; lane += stride) {
+        mask |= ((1 << cell_size) - 1) << (lane * cell_size);
+    }
+    return mask;
+}
+
+template <typename Cell>
+__m128i equal_to_zero(__m128i v) {
+    const __m128i zero = _mm_setzero_si128();
+    if constexpr (sizeof(Cell) == 1) {
+        return _mm_cmpeq_epi8(v, zero);
+    } else if constexpr (sizeof(Cell) == 2) {
+        return _mm_cmpeq_epi16(v, zero);
+    } else {
+        return _mm_cmpeq_epi32(v, zero);
+    }
+}
+#endif
+}  // namespace
+
+template <typename Cell>
+BasicTape<Cell>::BasicTape() : cells_(kPageSize, 0) {}
+
+template <typename Cell>
+void BasicTape<Cell>::grow(int index) {
+    if (index >= end_index()) {
+        // Growing upwards is the common case: every stack frame bfs pushes
+        // lives above the previous one. std::vector amortizes the copies.
+        cells_.resize(static_cast<size_t>(page_floor(index) + kPageSize - origin_), 0);
+        return;
+    }
+    // Growing downwards shifts every cell, so at least double the tape to
+    // keep the cost amortized.
+    int new_origin = std::min(page_floor(index), origin_ - static_cast<int>(cells_.size()));
+    cells_.insert(cells_.begin(), static_cast<size_t>(origin_ - new_origin), 0);
+    origin_ = new_origin;
+}
+
+template <typename Cell>
+int BasicTape<Cell>::find_zero(int from, int stride) const {
+    // Cells outside the allocated pages are zero, so every scan ends at the
+    // latest on the first index past either end of the tape.
+    int index = from;
+    const Cell* cells = cells_.data() - origin_;
+#ifdef __SSE2__
+    // Strides that divide the number of cells per vector test a whole vector
+    // per compare; the lane mask keeps only the lanes that lie on the stride.
+    // SSE2 has no 64-bit compare, so 64-bit cells are tested one by one.
+    constexpr int kLanes = 16 / sizeof(Cell);
+    int distance = stride < 0 ? -stride : stride;
+    if (sizeof(Cell) < 8 && distance < kLanes && kLanes % distance == 0) {
+        int lanes = lane_mask(distance, sizeof(Cell));
+        if (stride > 0) {
+            while (index >= origin_ && index + kLanes <= end_index()) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells + index));
+                int mask = _mm_movemask_epi8(equal_to_zero<Cell>(v)) & lanes;
+                if (mask != 0) {
+                    return index + __builtin_ctz(mask) / sizeof(Cell);
+                }
+                index += kLanes;
+            }
+        } else {
+            // Going down, index is the last lane of the vector.
+            lanes <<= (distance - 1) * sizeof(Cell);
+            while (index - (kLanes - 1) >= origin_ && index < end_index()) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells + index - (kLanes - 1)));
+                int mask = _mm_movemask_epi8(equal_to_zero<Cell>(v)) & lanes;
+                if (mask != 0) {
+                    return index - (kLanes - 1) + (31 - __builtin_clz(mask)) / sizeof(Cell);
+                }
+                index -= kLanes;
+            }
+        }
+    }
+#endif
+    while (index >= origin_ && index < end_index() && cells[index] != 0) {
+        index += stride;
+    }
+    return index;
+}
+
+template class BasicTape<uint8_t>;
+template class BasicTape<uint16_t>;
+template class BasicTape<uint32_t>;
+template class BasicTape<uint64_t>;
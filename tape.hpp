@@ -0,0 +1,70 @@
+#ifndef TAPE_HPP
+#define TAPE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using Word = uint32_t;
+
+// Contiguous tape that grows lazily one page at a time in both directions, so
+// negative cell indices work and the dense frames bfs emits stay in cache.
+// Cell is the unsigned type of one cell; it is instantiated for 8, 16, 32 and
+// 64 bits in tape.cc.
+template <typename Cell>
+class BasicTape {
+public:
+    static constexpr int kPageSize = 4096;  // in cells
+
+    BasicTape();
+    Cell& operator[](int index) {
+        size_t offset = static_cast<size_t>(index - origin_);
+        if (offset >= cells_.size()) {
+            grow(index);
+            offset = static_cast<size_t>(index - origin_);
+        }
+        return cells_[offset];
+    }
+    // Makes sure index is backed by memory without touching it.
+    void ensure(int index) {
+        if (static_cast<size_t>(index - origin_) >= cells_.size()) {
+            grow(index);
+        }
+    }
+    // Sets the count cells from index on to zero.
+    void clear(int index, int count) {
+        ensure(index);
+        ensure(index + count - 1);
+        Cell* cells = zero_cell() + index;
+        std::fill(cells, cells + count, 0);
+    }
+    // Pointer to cell 0, valid for indices in [begin_index(), end_index())
+    // until the tape grows again.
+    Cell* zero_cell() { return cells_.data() - origin_; }
+    // Returns the first index from + k * stride (k >= 0) that holds zero.
+    int find_zero(int from, int stride) const;
+    // Lowest and one past the highest cell index currently backed by memory.
+    int begin_index() const { return origin_; }
+    int end_index() const { return origin_ + static_cast<int>(cells_.size()); }
+    // The tape never shrinks, so the allocated size is also the peak use.
+    size_t peak_cells() const { return cells_.size(); }
+    size_t peak_pages() const { return cells_.size() / kPageSize; }
+
+private:
+    void grow(int index);
+
+    std::vector<Cell> cells_;
+    // Cell index stored at cells_[0]; always a multiple of kPageSize.
+    int origin_ = 0;
+};
+
+extern template class BasicTape<uint8_t>;
+extern template class BasicTape<uint16_t>;
+extern template class BasicTape<uint32_t>;
+extern template class BasicTape<uint64_t>;
+
+// The 32-bit tape, which the jit and the emitted programs use.
+using Tape = BasicTape<Word>;
+
+#endif  // TAPE_HPP
@@ -0,0 +1,213 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+// The file is the magic and then 64-bit integers in host byte order: the
+// version, the chunk size, the end reason, the signal, the steps and tape
+// pointer at the end, the length of the error message followed by the
+// message, the loop count followed by op index, line and column of every
+// loop, the number of dropped chunks and the number of chunks that follow.
+// Every chunk is its ChunkHeader and then its events, oldest chunk first. An
+// event is a tag byte, whose low two bits are the EventKind, then the zigzag
+// varint difference of the loop unless the tag has kSameLoop, of the tape
+// pointer unless it has kSameTp, and the iterations of a kExit as a varint.
+const char kMagic[8] = {'B', 'F', 'I', 'T', 'R', 'A', 'C', 'E'};
+const uint64_t kVersion = 1;
+
+bool write_all(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, bytes, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Reads data, which it does not copy, and names path in its errors.
+class Reader {
+public:
+    Reader(const std::string& path, const std::string& data) : path_(path), data_(data) {}
+
+    const char* take(size_t size) {
+        if (data_.size() - pos_ < size) {
+            throw std::runtime_error(path_ + " is truncated");
+        }
+        pos_ += size;
+        return data_.data() + pos_ - size;
+    }
+    uint64_t read_int() {
+        uint64_t value;
+        std::memcpy(&value, take(sizeof(value)), sizeof(value));
+        return value;
+    }
+    uint64_t read_varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64 && !done(); shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(data_[pos_++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+        throw std::runtime_error(path_ + " has a broken event");
+    }
+    int64_t read_signed() {
+        uint64_t value = read_varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+    bool done() const { return pos_ == data_.size(); }
+
+private:
+    const std::string& path_;
+    const std::string& data_;
+    size_t pos_ = 0;
+};
+
+}  // namespace
+
+TraceRecorder::TraceRecorder(size_t capacity, std::string_view source, const std::vector<size_t>& instruction_offsets,
+                             const std::vector<Op>& code, const DebugInfo& debug_info)
+    : chunks_(std::max<size_t>(1, (capacity + kChunkSize - 1) / kChunkSize)) {
+    std::vector<size_t> line_starts = {0};
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] == '\n') {
+            line_starts.push_back(i + 1);
+        }
+    }
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        if (code[ip].code != OpCode::kLoopStart) {
+            continue;
+        }
+        size_t position = ip < debug_info.positions.size() ? debug_info.positions[ip] : instruction_offsets.size();
+        size_t offset = position < instruction_offsets.size() ? instruction_offsets[position] : source.size();
+        size_t line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin() - 1;
+        loops_.insert(loops_.end(), {ip, line + 1, offset - line_starts[line] + 1});
+    }
+    memory_.resize(chunks_ * kChunkSize);
+    current_ = chunks_ - 1;
+    next_chunk(0);
+}
+
+void TraceRecorder::next_chunk(size_t steps) {
+    if (started_ > 0) {
+        chunk(current_)->size = pos_ - (memory_.data() + current_ * kChunkSize + sizeof(ChunkHeader));
+    }
+    current_ = (current_ + 1) % chunks_;
+    started_++;
+    ChunkHeader* header = chunk(current_);
+    header->steps = steps;
+    header->loop = last_loop_;
+    header->tp = last_tp_;
+    header->size = 0;
+    pos_ = reinterpret_cast<uint8_t*>(header + 1);
+    chunk_end_ = memory_.data() + (current_ + 1) * kChunkSize;
+}
+
+void TraceRecorder::set_end(EndReason reason, size_t steps, int tp, const std::string& message) {
+    reason_ = reason;
+    last_steps_ = steps;
+    end_tp_ = tp;
+    message_ = message;
+}
+
+void TraceRecorder::set_signal(int signal) {
+    reason_ = EndReason::kSignal;
+    signal_ = signal;
+    end_tp_ = last_tp_;
+}
+
+bool TraceRecorder::write(int fd) {
+    chunk(current_)->size = pos_ - (memory_.data() + current_ * kChunkSize + sizeof(ChunkHeader));
+    uint64_t count = std::min<uint64_t>(started_, chunks_);
+    uint64_t header[] = {kVersion,
+                         kChunkSize,
+                         static_cast<uint64_t>(reason_),
+                         static_cast<uint64_t>(signal_),
+                         last_steps_,
+                         static_cast<uint64_t>(static_cast<int64_t>(end_tp_)),
+                         message_.size()};
+    uint64_t loop_count = loops_.size() / 3;
+    uint64_t chunk_counts[] = {started_ - count, count};
+    if (!write_all(fd, kMagic, sizeof(kMagic)) || !write_all(fd, header, sizeof(header)) ||
+        !write_all(fd, message_.data(), message_.size()) || !write_all(fd, &loop_count, sizeof(loop_count)) ||
+        !write_all(fd, loops_.data(), loops_.size() * sizeof(uint64_t)) ||
+        !write_all(fd, chunk_counts, sizeof(chunk_counts))) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        const ChunkHeader* oldest = chunk((current_ + chunks_ - count + 1 + i) % chunks_);
+        if (!write_all(fd, oldest, sizeof(ChunkHeader) + oldest->size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TraceFile read_trace(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("could not open trace " + path);
+    }
+    std::string data(std::istreambuf_iterator<char>(file), {});
+    Reader reader(path, data);
+    if (!std::equal(kMagic, kMagic + sizeof(kMagic), reader.take(sizeof(kMagic)))) {
+        throw std::runtime_error(path + " is not a bfi trace");
+    }
+    if (reader.read_int() != kVersion) {
+        throw std::runtime_error(path + " was written by a different version of bfi");
+    }
+    reader.read_int();  // chunk size
+    TraceFile trace;
+    trace.reason = static_cast<TraceRecorder::EndReason>(reader.read_int());
+    trace.signal = static_cast<int>(reader.read_int());
+    trace.steps = reader.read_int();
+    trace.tp = static_cast<int>(static_cast<int64_t>(reader.read_int()));
+    size_t message_size = reader.read_int();
+    trace.message.assign(reader.take(message_size), message_size);
+    for (uint64_t loops = reader.read_int(); loops > 0; loops--) {
+        size_t ip = reader.read_int();
+        size_t line = reader.read_int();
+        trace.loops.push_back({ip, TraceLoop{line, reader.read_int()}});
+    }
+    trace.dropped_chunks = reader.read_int();
+    for (uint64_t chunks = reader.read_int(); chunks > 0; chunks--) {
+        TraceChunk chunk;
+        chunk.steps = reader.read_int();
+        int64_t loop = static_cast<int64_t>(reader.read_int());
+        int64_t tp = static_cast<int64_t>(reader.read_int());
+        size_t size = reader.read_int();
+        std::string chunk_data(reader.take(size), size);
+        Reader events(path, chunk_data);
+        while (!events.done()) {
+            uint8_t tag = static_cast<uint8_t>(*events.take(1));
+            TraceEvent event;
+            event.kind = static_cast<TraceRecorder::EventKind>(tag & 3);
+            if (!(tag & TraceRecorder::kSameLoop)) {
+                loop += events.read_signed();
+            }
+            if (!(tag & TraceRecorder::kSameTp)) {
+                tp += events.read_signed();
+            }
+            event.loop = static_cast<size_t>(loop);
+            event.tp = static_cast<int>(tp);
+            event.iterations = event.kind == TraceRecorder::EventKind::kExit ? events.read_varint() : 0;
+            chunk.events.push_back(event);
+        }
+        trace.chunks.push_back(std::move(chunk));
+    }
+    return trace;
+}
@@ -0,0 +1,176 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "bytecode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Records where a run went in a fixed amount of memory, to look at after a
+// long run has ended, failed or crashed: every loop entry, every jump back,
+// every exit with the number of iterations and every skipped loop, each with
+// the tape pointer at that block boundary. Loops are named by the index of
+// their kLoopStart. An event takes one byte plus varints for whatever differs
+// from the event before, so a loop that keeps jumping back at the same tape
+// pointer costs a byte per iteration. Events go into chunks of kChunkSize
+// bytes and once all chunks are full the oldest one is reused, so the trace
+// keeps the end of the run. Every chunk starts from absolute values, so it
+// decodes without the ones before.
+class TraceRecorder {
+public:
+    static constexpr size_t kChunkSize = 1 << 16;
+
+    enum class EventKind : uint8_t { kEnter, kIterate, kExit, kSkip };
+    enum class EndReason : uint8_t { kFinished, kError, kSignal };
+    // Set in the tag byte of an event when its loop or tape pointer is the
+    // same as the one before; the low two bits are the EventKind.
+    static constexpr uint8_t kSameLoop = 4;
+    static constexpr uint8_t kSameTp = 8;
+
+    // Keeps capacity bytes of events, rounded up to whole chunks.
+    // instruction_offsets maps every instruction of the compiled code to its
+    // offset in source, see filter_source(); the file lists the source line
+    // and column of every loop.
+    TraceRecorder(size_t capacity, std::string_view source, const std::vector<size_t>& instruction_offsets,
+                  const std::vector<Op>& code, const DebugInfo& debug_info);
+
+    // Called after the loop op of loop ran, having charged the run up to
+    // steps and left the tape pointer at tp.
+    void enter(size_t loop, int tp, size_t steps) {
+        iterations_.push_back(1);
+        record(EventKind::kEnter, loop, tp, steps, 0);
+    }
+    void iterate(size_t loop, int tp, size_t steps) {
+        if (!iterations_.empty()) {
+            iterations_.back()++;
+        }
+        record(EventKind::kIterate, loop, tp, steps, 0);
+    }
+    void exit(size_t loop, int tp, size_t steps) {
+        uint64_t iterations = 0;
+        if (!iterations_.empty()) {
+            iterations = iterations_.back();
+            iterations_.pop_back();
+        }
+        record(EventKind::kExit, loop, tp, steps, iterations);
+    }
+    void skip(size_t loop, int tp, size_t steps) { record(EventKind::kSkip, loop, tp, steps, 0); }
+
+    // Records how the run ended, for write(); message is the error of
+    // kError.
+    void set_end(EndReason reason, size_t steps, int tp, const std::string& message = "");
+    // Like set_end() for a run killed by signal, but safe in its handler.
+    void set_signal(int signal);
+    // Writes the trace to fd using nothing but write(), so a signal handler
+    // can call it. Returns false if a write failed.
+    bool write(int fd);
+
+private:
+    // The first bytes of every chunk: the step count when it was started
+    // and the loop and tape pointer its first event is relative to. size is
+    // the number of event bytes after the header, filled in when the chunk is
+    // closed or written.
+    struct ChunkHeader {
+        uint64_t steps;
+        uint64_t loop;
+        int64_t tp;
+        uint64_t size;
+    };
+    // A tag byte and three 10-byte varints.
+    static constexpr size_t kMaxEventSize = 31;
+
+    void record(EventKind kind, size_t loop, int tp, size_t steps, uint64_t iterations) {
+        if (static_cast<size_t>(chunk_end_ - pos_) < kMaxEventSize) {
+            next_chunk(steps);
+        }
+        uint8_t* tag = pos_++;
+        uint8_t flags = static_cast<uint8_t>(kind);
+        if (loop == last_loop_) {
+            flags |= kSameLoop;
+        } else {
+            put_signed(static_cast<int64_t>(loop) - static_cast<int64_t>(last_loop_));
+        }
+        if (tp == last_tp_) {
+            flags |= kSameTp;
+        } else {
+            put_signed(static_cast<int64_t>(tp) - last_tp_);
+        }
+        if (kind == EventKind::kExit) {
+            put(iterations);
+        }
+        *tag = flags;
+        last_loop_ = loop;
+        last_tp_ = tp;
+        last_steps_ = steps;
+    }
+    void put(uint64_t value) {
+        while (value >= 0x80) {
+            *pos_++ = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        *pos_++ = static_cast<uint8_t>(value);
+    }
+    void put_signed(int64_t value) {
+        put((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+    void next_chunk(size_t steps);
+    ChunkHeader* chunk(size_t index) { return reinterpret_cast<ChunkHeader*>(&memory_[index * kChunkSize]); }
+
+    // The file's loop table, ready to write.
+    std::vector<uint64_t> loops_;
+    std::vector<uint8_t> memory_;
+    size_t chunks_;
+    size_t current_ = 0;
+    // Chunks started so far, including the ones reused since.
+    uint64_t started_ = 0;
+    uint8_t* pos_;
+    uint8_t* chunk_end_;
+    size_t last_loop_ = 0;
+    int last_tp_ = 0;
+    size_t last_steps_ = 0;
+    // Iterations of the loops the run is in, innermost last.
+    std::vector<uint64_t> iterations_;
+    EndReason reason_ = EndReason::kFinished;
+    int signal_ = 0;
+    int end_tp_ = 0;
+    std::string message_;
+};
+
+// A trace file read back, see TraceRecorder.
+struct TraceEvent {
+    TraceRecorder::EventKind kind;
+    size_t loop;
+    int tp;
+    uint64_t iterations;  // kExit only
+};
+
+struct TraceChunk {
+    uint64_t steps;
+    std::vector<TraceEvent> events;
+};
+
+struct TraceLoop {
+    size_t line;
+    size_t column;
+};
+
+struct TraceFile {
+    TraceRecorder::EndReason reason;
+    int signal;
+    std::string message;
+    uint64_t steps;
+    int tp;
+    // Chunks that were reused, so their events are gone.
+    uint64_t dropped_chunks;
+    // Source position of the loop starting at each op index.
+    std::vector<std::pair<size_t, TraceLoop>> loops;
+    std::vector<TraceChunk> chunks;
+};
+
+// Reads a file written by TraceRecorder::write(). Throws std::runtime_error.
+TraceFile read_trace(const std::string& path);
+
+#endif  // TRACE_HPP